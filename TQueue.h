@@ -19,6 +19,17 @@ public:
 
     virtual void SetDatabase(void *db) = 0;
 
+    /**
+    * @brief Read only connection to use for loads, NULL to use the database.
+    */
+    virtual void SetReplica(void *db) = 0;
+
+    /**
+    * @brief Called inside the thread as soon as the operation is taken
+    * off the queue, before the connection is checked.
+    */
+    virtual void OnDequeued() = 0;
+
     /**
     * @brief Called inside the thread; this is where any blocking
     * or threaded operations must occur.
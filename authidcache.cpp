@@ -0,0 +1,100 @@
+#include "authidcache.h"
+
+#include <algorithm>
+
+// Expired entries are only dropped once this many players are cached
+static const size_t PRUNE_THRESHOLD = 1024;
+
+AuthIdCache::AuthIdCache() : ttl(5000)
+{
+    std::fill(std::begin(generations), std::end(generations), 0);
+}
+
+void AuthIdCache::SetTTL(uint32_t ms)
+{
+    ttl = std::chrono::milliseconds(ms);
+    Clear();
+}
+
+bool AuthIdCache::Lookup(const std::string &authid, const std::vector<int> &ids, rows &out)
+{
+    auto iter = players.find(authid);
+    if (iter == players.end()) {
+        return false;
+    }
+
+    entry &cached = iter->second;
+    if (cached.expires <= clock::now()) {
+        players.erase(iter);
+        return false;
+    }
+
+    for (int id : ids) {
+        if (!std::binary_search(cached.known.begin(), cached.known.end(), id)) {
+            return false;
+        }
+    }
+
+    for (int id : ids) {
+        auto value = cached.values.find(id);
+        if (value != cached.values.end()) {
+            out.emplace_back(id, std::string(value->second));
+        }
+    }
+
+    return true;
+}
+
+void AuthIdCache::Insert(const std::string &authid, const std::vector<int> &ids, const rows &values, uint64_t generation)
+{
+    // The player was written or dropped while we were reading, the values might be outdated
+    if (ttl.count() == 0 || generations[Slot(authid)] != generation) {
+        return;
+    }
+
+    clock::time_point now = clock::now();
+    if (players.size() >= PRUNE_THRESHOLD) {
+        Prune(now);
+    }
+
+    // Replaces whatever was cached, the ids read together expire together
+    entry &cached = players[authid];
+    cached.expires = now + ttl;
+    cached.values.clear();
+    cached.known = ids;
+    std::sort(cached.known.begin(), cached.known.end());
+
+    for (const CookieRow &row : values) {
+        cached.values[row.id] = row.value;
+    }
+}
+
+void AuthIdCache::Evict(const std::string &authid)
+{
+    ++generations[Slot(authid)];
+    players.erase(authid);
+}
+
+void AuthIdCache::Clear()
+{
+    for (uint64_t &generation : generations) {
+        ++generation;
+    }
+    players.clear();
+}
+
+void AuthIdCache::Prune(clock::time_point now)
+{
+    for (auto iter = players.begin(); iter != players.end();) {
+        if (iter->second.expires <= now) {
+            iter = players.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+
+    // Everything is still fresh, lookups of that many players are not worth keeping
+    if (players.size() >= PRUNE_THRESHOLD) {
+        players.clear();
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+#include <functional>
+#include <stdint.h>
+
+#include "cookierow.h"
+
+/**
+ * Recent results of offline cookie reads, so a plugin looking up the same player
+ * again within a few seconds is answered without a query.
+ *
+ * Entries expire after a short time instead of being kept coherent, writes made
+ * from this server drop the player right away. A read that was in flight while its
+ * player was dropped is not cached. Main thread only.
+ */
+class AuthIdCache
+{
+public:
+    typedef CookieRows rows;
+
+    AuthIdCache();
+
+    // 0 disables the cache
+    void SetTTL(uint32_t ms);
+
+    // Fill out with the values of ids if every one of them was read recently
+    bool Lookup(const std::string &authid, const std::vector<int> &ids, rows &out);
+
+    // Take it before reading from Redis, the read is not cached if authid is evicted meanwhile
+    uint64_t Generation(const std::string &authid) const
+    {
+        return generations[Slot(authid)];
+    }
+
+    void Insert(const std::string &authid, const std::vector<int> &ids, const rows &values, uint64_t generation);
+
+    void Evict(const std::string &authid);
+
+    void Clear();
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct entry
+    {
+        clock::time_point expires;
+        std::unordered_map<int, std::string> values;
+        std::vector<int> known;             // sorted ids read from Redis, with or without a value
+    };
+
+    void Prune(clock::time_point now);
+
+    // Players share a generation slot by hash, a collision only skips caching a read
+    static size_t Slot(const std::string &authid)
+    {
+        return std::hash<std::string>()(authid) % GENERATION_SLOTS;
+    }
+
+    static const size_t GENERATION_SLOTS = 1024;
+    uint64_t generations[GENERATION_SLOTS];
+
+    std::unordered_map<std::string, entry> players;
+    std::chrono::milliseconds ttl;
+};
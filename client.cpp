@@ -19,6 +19,62 @@ using namespace std::chrono_literals;
 
 namespace async_redis
 {
+// Reply object functions handing a reply to a decoder, every object "created" is the decoder itself
+static int TaskDepth(const redisReadTask *task)
+{
+    int depth = 0;
+    for (const redisReadTask *parent = task->parent; parent; parent = parent->parent) {
+        ++depth;
+    }
+    return depth;
+}
+
+static void *DecodeString(const redisReadTask *task, char *str, size_t len)
+{
+    decoder *dec = (decoder *)task->privdata;
+    if (task->type == REDIS_REPLY_ERROR) {
+        if (dec->error.empty()) {
+            dec->error.assign(str, len);
+        }
+    } else if (task->type == REDIS_REPLY_STRING) {
+        dec->String(TaskDepth(task), task->idx, str, len);
+    }
+    return dec;
+}
+
+static void *DecodeArray(const redisReadTask *task, int elements)
+{
+    decoder *dec = (decoder *)task->privdata;
+    dec->Array(TaskDepth(task), task->idx, elements);
+    return dec;
+}
+
+static void *DecodeInteger(const redisReadTask *task, PORT_LONGLONG value)
+{
+    decoder *dec = (decoder *)task->privdata;
+    dec->Integer(TaskDepth(task), task->idx, value);
+    return dec;
+}
+
+static void *DecodeNil(const redisReadTask *task)
+{
+    decoder *dec = (decoder *)task->privdata;
+    dec->Nil(TaskDepth(task), task->idx);
+    return dec;
+}
+
+static void DecodeFree(void *)
+{
+}
+
+static redisReplyObjectFunctions decodeFunctions = {
+    DecodeString,
+    DecodeArray,
+    DecodeInteger,
+    DecodeNil,
+    DecodeFree,
+};
+
 client::client(size_t _piped_cache, uint32_t pipeline_timeout) :
     cache_size(_piped_cache), pipe_timeout(pipeline_timeout), ctx(nullptr)
 {
@@ -100,6 +156,26 @@ bool client::Connect(const std::string & host, int port, uint32_t timeout_ms)
                     auto &req = reqs[i];
                     redisReply *rawReply = nullptr;
 
+                    if (req.dec) {
+                        // Parse this reply straight into the decoder, nothing is allocated for it
+                        req.dec->Reset();
+
+                        redisReplyObjectFunctions *fn = ctx->reader->fn;
+                        ctx->reader->fn = &decodeFunctions;
+                        ctx->reader->privdata = req.dec;
+
+                        void *decoded = nullptr;
+                        bool received = appended[i] && redisGetReply(ctx, &decoded) == REDIS_OK;
+
+                        ctx->reader->fn = fn;
+                        ctx->reader->privdata = nullptr;
+
+                        if (req.decoded) {
+                            req.decoded(received);
+                        }
+                        continue;
+                    }
+
                     bool success = appended[i];
                     if (success) {
                         success &= redisGetReply(ctx, (void **)&rawReply) == REDIS_OK;
@@ -153,13 +229,19 @@ void client::Disconnect()
     }
 }
 
-client & client::Append(const std::vector<std::string> &redis_cmd, const reply_callback & callback)
+connection & client::Append(const std::vector<std::string> &redis_cmd, const reply_callback & callback)
+{
+    m_commands.enqueue({ formatCommand(redis_cmd), callback, nullptr, nullptr });
+    return *this;
+}
+
+connection & client::AppendDecoded(const std::vector<std::string> &redis_cmd, decoder *dec, const decode_callback & callback)
 {
-    m_commands.enqueue({ formatCommand(redis_cmd), callback });
+    m_commands.enqueue({ formatCommand(redis_cmd), nullptr, dec, callback });
     return *this;
 }
 
-client & client::Commit()
+connection & client::Commit()
 {
     flush_pipeline = true;
     if (IsConnected() && cache_size == 0) {
@@ -6,16 +6,15 @@
 #include <thread>
 #include <vector>
 #include <functional>
-#include <future>
 #include <atomic>
 
-#include "reply.h"
+#include "connection.h"
 
 struct redisContext;
 
 namespace async_redis
 {
-class client
+class client : public connection
 {
 public:
     /**
@@ -33,39 +32,32 @@ public:
     client(size_t piped_cache = 0, uint32_t pipeline_timeout = 0);
     ~client();
 
-    bool Connect(const std::string &host, int port, uint32_t timeout_ms);
+    bool Connect(const std::string &host, int port, uint32_t timeout_ms) override;
 
-    bool IsConnected() const;
+    bool IsConnected() const override;
 
-    void Disconnect();
+    void Disconnect() override;
 
-    // bool: if successfully sent and receive, reply: actual reply content
-    typedef std::function<void(reply *)> reply_callback;
+    connection &Append(const std::vector<std::string> &redis_cmd, const reply_callback &callback = nullptr) override;
 
-    client &Append(const std::vector<std::string> &redis_cmd, const reply_callback &callback = nullptr);
-
-    std::future<std::unique_ptr<reply>> Command(const std::vector<std::string> &redis_cmd, bool commit = true)
-    {
-        auto prms = std::make_shared<std::promise<std::unique_ptr<reply>>>();
-        Append(redis_cmd, [prms](auto r) { prms->set_value(std::unique_ptr<reply>(r)); });
-        if (commit) {
-            Commit();
-        }
-        return prms->get_future();
-    }
+    connection &AppendDecoded(const std::vector<std::string> &redis_cmd, decoder *dec, const decode_callback &callback) override;
 
     // This function will do nothing when auto pipeline enabled
     // If pipeline was enable, it will force worker to commit existing command
-    client &Commit();
+    connection &Commit() override;
 
-    int GetError() const;
-    const char *GetErrorString() const;
+    int GetError() const override;
+    const char *GetErrorString() const override;
 
 private:
     struct command_request
     {
         std::string command;
         reply_callback callback;
+
+        // Set instead of callback for decoded commands
+        decoder *dec;
+        decode_callback decoded;
     };
 
     static std::string formatCommand(const std::vector<std::string> &redis_cmd);
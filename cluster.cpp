@@ -0,0 +1,470 @@
+#include "cluster.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define CLUSTER_SLOTS 16384
+#define CLUSTER_MAX_REDIRECTS 5
+
+namespace async_redis
+{
+// CRC16-CCITT (XMODEM), the key hash used by Redis Cluster
+static uint16_t crc16(const char *buf, size_t len)
+{
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= (uint16_t)((unsigned char)buf[i] << 8);
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+cluster::cluster(const std::string &_password) :
+    password(_password), timeout(0), seed_port(0), slots(CLUSTER_SLOTS, -1)
+{
+    refresh = false;
+}
+
+cluster::~cluster()
+{
+    Disconnect();
+}
+
+bool cluster::Connect(const std::string &host, int port, uint32_t timeout_ms)
+{
+    Disconnect();
+
+    seed_host = host;
+    seed_port = port;
+    timeout = timeout_ms;
+
+    if (!Node(host, port)) {
+        return false;
+    }
+
+    return RefreshSlots();
+}
+
+bool cluster::IsConnected() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (const auto &n : nodes) {
+        if (n->conn && n->conn->IsConnected()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void cluster::Disconnect()
+{
+    std::vector<std::unique_ptr<node>> old;
+    std::vector<std::unique_ptr<client>> dropped;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        old.swap(nodes);
+        dropped.swap(retired);
+        slots.assign(CLUSTER_SLOTS, -1);
+    }
+
+    // Joins the node workers, which may be waiting for the lock in a redirect
+    old.clear();
+    dropped.clear();
+}
+
+connection &cluster::Append(const std::vector<std::string> &redis_cmd, const reply_callback &callback)
+{
+    if (refresh.exchange(false)) {
+        RefreshSlots();
+    }
+
+    const std::string *key = KeyOf(redis_cmd);
+    if (key) {
+        client *target = NodeForSlot(Slot(*key));
+        if (target) {
+            Send(target, redis_cmd, callback, 0, false);
+        } else if (callback) {
+            callback(nullptr);
+        }
+        return *this;
+    }
+
+    std::vector<client *> targets;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto &n : nodes) {
+            if (n->conn && n->conn->IsConnected()) {
+                targets.push_back(n->conn.get());
+            }
+        }
+    }
+
+    if (targets.empty()) {
+        if (callback) {
+            callback(nullptr);
+        }
+        return *this;
+    }
+
+    const std::string &name = redis_cmd[0];
+    bool broadcast = name == "SCRIPT" || name == "AUTH";
+    if (!broadcast) {
+        targets.resize(1);
+    }
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        targets[i]->Append(redis_cmd, i == 0 ? callback : [](reply *r) { delete r; });
+    }
+    return *this;
+}
+
+connection &cluster::AppendDecoded(const std::vector<std::string> &redis_cmd, decoder *dec, const decode_callback &callback)
+{
+    if (refresh.exchange(false)) {
+        RefreshSlots();
+    }
+
+    // Decoded commands are never broadcast, without a key any node will do
+    const std::string *key = KeyOf(redis_cmd);
+    client *target = nullptr;
+    if (key) {
+        target = NodeForSlot(Slot(*key));
+    } else {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto &n : nodes) {
+            if (n->conn && n->conn->IsConnected()) {
+                target = n->conn.get();
+                break;
+            }
+        }
+    }
+
+    if (target) {
+        SendDecoded(target, redis_cmd, dec, callback, 0, false);
+    } else if (callback) {
+        callback(false);
+    }
+    return *this;
+}
+
+connection &cluster::Commit()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (const auto &n : nodes) {
+        if (n->conn) {
+            n->conn->Commit();
+        }
+    }
+    return *this;
+}
+
+int cluster::GetError() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (const auto &n : nodes) {
+        if (n->conn && n->conn->GetError()) {
+            return n->conn->GetError();
+        }
+    }
+    return nodes.empty() ? -1 : 0;
+}
+
+const char *cluster::GetErrorString() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (const auto &n : nodes) {
+        if (n->conn && n->conn->GetError()) {
+            return n->conn->GetErrorString();
+        }
+    }
+    return nodes.empty() ? "not connected to any cluster node" : "";
+}
+
+uint16_t cluster::Slot(const std::string &key)
+{
+    size_t open = key.find('{');
+    if (open != std::string::npos) {
+        size_t close = key.find('}', open + 1);
+        if (close != std::string::npos && close != open + 1) {
+            return crc16(key.data() + open + 1, close - open - 1) & (CLUSTER_SLOTS - 1);
+        }
+    }
+
+    return crc16(key.data(), key.size()) & (CLUSTER_SLOTS - 1);
+}
+
+bool cluster::RefreshSlots()
+{
+    // Ask any node that is still there, never wait for a reply while holding the lock
+    std::vector<std::pair<std::string, int>> candidates;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto &n : nodes) {
+            candidates.push_back({ n->host, n->port });
+        }
+    }
+    candidates.push_back({ seed_host, seed_port });
+
+    for (const auto &[host, port] : candidates) {
+        client *conn = Node(host, port);
+        if (!conn) {
+            continue;
+        }
+
+        auto rep = conn->Command({ "CLUSTER", "SLOTS" }).get();
+        if (!rep || !rep->IsArrays()) {
+            continue;
+        }
+
+        // [ [start, end, [ip, port, id], replicas...], ... ]
+        std::vector<std::tuple<int, int, std::string, int>> ranges;
+        for (const auto &range : rep->GetArray()) {
+            if (!range.IsArrays() || range.GetArray().size() < 3) {
+                continue;
+            }
+
+            const auto &fields = range.GetArray();
+            const auto &master = fields[2];
+            if (!fields[0].IsInt() || !fields[1].IsInt() || !master.IsArrays() || master.GetArray().size() < 2) {
+                continue;
+            }
+
+            const auto &address = master.GetArray();
+            std::string ip = address[0].IsString() ? address[0].GetString() : std::string();
+            ranges.emplace_back((int)fields[0].GetInt(), (int)fields[1].GetInt(),
+                ip.empty() ? host : ip, (int)address[1].GetInt());
+        }
+
+        if (ranges.empty()) {
+            continue;
+        }
+
+        std::vector<int> owners(CLUSTER_SLOTS, -1);
+        for (const auto &[start, end, ip, node_port] : ranges) {
+            // Connecting to the node also makes sure it has an index
+            if (!Node(ip, node_port)) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            int index = -1;
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                if (nodes[i]->host == ip && nodes[i]->port == node_port) {
+                    index = (int)i;
+                    break;
+                }
+            }
+
+            for (int slot = start; slot <= end && slot < CLUSTER_SLOTS; ++slot) {
+                owners[slot] = index;
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        slots.swap(owners);
+        return true;
+    }
+
+    return false;
+}
+
+client *cluster::Node(const std::string &host, int port)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto &n : nodes) {
+            if (n->host == host && n->port == port) {
+                if (n->conn && n->conn->IsConnected()) {
+                    return n->conn.get();
+                }
+
+                // Never freed here, another thread may still be using it or running on it
+                if (n->conn) {
+                    retired.push_back(std::move(n->conn));
+                }
+                break;
+            }
+        }
+    }
+
+    // Connect without the lock, the node index stays the same if it was known
+    auto conn = std::make_unique<client>();
+    if (!conn->Connect(host, port, timeout)) {
+        return nullptr;
+    }
+
+    if (!password.empty()) {
+        auto rep = conn->Command({ "AUTH", password }).get();
+        if (!rep || !rep->IsStatus()) {
+            return nullptr;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (const auto &n : nodes) {
+        if (n->host == host && n->port == port) {
+            if (n->conn && n->conn->IsConnected()) {
+                // Someone else was faster, ours is dropped
+                return n->conn.get();
+            }
+            n->conn = std::move(conn);
+            return n->conn.get();
+        }
+    }
+
+    nodes.push_back(std::make_unique<node>(node{ host, port, std::move(conn) }));
+    return nodes.back()->conn.get();
+}
+
+client *cluster::NodeForSlot(int slot)
+{
+    std::string host;
+    int port;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        int index = slots[slot];
+        if (index < 0) {
+            if (nodes.empty()) {
+                return nullptr;
+            }
+            // Unknown slot, any node will redirect us to the right one
+            index = 0;
+            refresh = true;
+        }
+
+        if (nodes[index]->conn && nodes[index]->conn->IsConnected()) {
+            return nodes[index]->conn.get();
+        }
+
+        host = nodes[index]->host;
+        port = nodes[index]->port;
+    }
+
+    // The node went away, it may have failed over
+    refresh = true;
+    return Node(host, port);
+}
+
+void cluster::Send(client *target, const std::vector<std::string> &redis_cmd, const reply_callback &callback, int redirects, bool asking)
+{
+    if (asking) {
+        // Only the very next command is allowed in the importing slot, an ASK is followed again otherwise
+        target->Append({ "ASKING" }, [](reply *r) { delete r; });
+    }
+
+    target->Append(redis_cmd, [this, redis_cmd, callback, redirects](reply *r) {
+        if (!r) {
+            refresh = true;
+        } else if (r->IsError() && redirects < CLUSTER_MAX_REDIRECTS) {
+            bool ask = false;
+            client *next = Redirect(r->Status(), ask);
+            if (next) {
+                delete r;
+                Send(next, redis_cmd, callback, redirects + 1, ask);
+                next->Commit();
+                return;
+            }
+        }
+
+        if (callback) {
+            callback(r);
+        } else {
+            delete r;
+        }
+    });
+}
+
+void cluster::SendDecoded(client *target, const std::vector<std::string> &redis_cmd, decoder *dec, const decode_callback &callback, int redirects, bool asking)
+{
+    if (asking) {
+        target->Append({ "ASKING" }, [](reply *r) { delete r; });
+    }
+
+    target->AppendDecoded(redis_cmd, dec, [this, redis_cmd, dec, callback, redirects](bool received) {
+        if (!received) {
+            refresh = true;
+        } else if (!dec->error.empty() && redirects < CLUSTER_MAX_REDIRECTS) {
+            bool ask = false;
+            client *next = Redirect(dec->error.c_str(), ask);
+            if (next) {
+                SendDecoded(next, redis_cmd, dec, callback, redirects + 1, ask);
+                next->Commit();
+                return;
+            }
+        }
+
+        if (callback) {
+            callback(received);
+        }
+    });
+}
+
+client *cluster::Redirect(const char *msg, bool &ask)
+{
+    // "MOVED 3999 127.0.0.1:6381" or "ASK 3999 127.0.0.1:6381"
+    bool moved = strncmp(msg, "MOVED ", 6) == 0;
+    ask = strncmp(msg, "ASK ", 4) == 0;
+    if (!moved && !ask) {
+        return nullptr;
+    }
+
+    char *end = nullptr;
+    long slot = strtol(strchr(msg, ' ') + 1, &end, 10);
+    const char *address = end && *end == ' ' ? end + 1 : "";
+    const char *colon = strrchr(address, ':');
+    if (!colon || slot < 0 || slot >= CLUSTER_SLOTS) {
+        return nullptr;
+    }
+
+    std::string host(address, colon - address);
+    int port = atoi(colon + 1);
+
+    client *next = Node(host, port);
+    if (next && moved) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i]->host == host && nodes[i]->port == port) {
+                slots[slot] = (int)i;
+                break;
+            }
+        }
+
+        // Slots usually move in batches, get the whole picture
+        refresh = true;
+    }
+
+    return next;
+}
+
+const std::string *cluster::KeyOf(const std::vector<std::string> &redis_cmd)
+{
+    if (redis_cmd.size() < 2) {
+        return nullptr;
+    }
+
+    // Command names are always sent in upper case
+    const char *name = redis_cmd[0].c_str();
+    if (strcmp(name, "EVAL") == 0 || strcmp(name, "EVALSHA") == 0
+        || strcmp(name, "EVAL_RO") == 0 || strcmp(name, "EVALSHA_RO") == 0) {
+        // EVALSHA sha numkeys key...
+        if (redis_cmd.size() < 4 || atoi(redis_cmd[2].c_str()) < 1) {
+            return nullptr;
+        }
+        return &redis_cmd[3];
+    }
+
+    if (strcmp(name, "SCRIPT") == 0 || strcmp(name, "AUTH") == 0
+        || strcmp(name, "CLUSTER") == 0 || strcmp(name, "SELECT") == 0
+        || strcmp(name, "PING") == 0 || strcmp(name, "INFO") == 0) {
+        return nullptr;
+    }
+
+    return &redis_cmd[1];
+}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+
+#include "client.h"
+
+namespace async_redis
+{
+/**
+ * A Redis Cluster, every command is sent to the node owning the hash slot of its key
+ *
+ * The slot map is loaded with CLUSTER SLOTS on connect. MOVED replies update it and
+ * get the whole map reloaded before the next command, ASK replies are followed for that
+ * command only. Commands without a key go to any node, except SCRIPT and AUTH which
+ * are sent to every node (the reply is the one of the first node).
+ */
+class cluster : public connection
+{
+public:
+    // The password is sent to every node we connect to
+    cluster(const std::string &password = std::string());
+    ~cluster();
+
+    // Connect to any node of the cluster and load the slot map
+    bool Connect(const std::string &host, int port, uint32_t timeout_ms) override;
+
+    bool IsConnected() const override;
+
+    void Disconnect() override;
+
+    connection &Append(const std::vector<std::string> &redis_cmd, const reply_callback &callback = nullptr) override;
+
+    connection &AppendDecoded(const std::vector<std::string> &redis_cmd, decoder *dec, const decode_callback &callback) override;
+
+    connection &Commit() override;
+
+    bool IsCluster() const override
+    {
+        return true;
+    }
+
+    int GetError() const override;
+    const char *GetErrorString() const override;
+
+    // Hash slot of a key, only the part between the first { and the next } counts if it is not empty
+    static uint16_t Slot(const std::string &key);
+
+private:
+    struct node
+    {
+        std::string host;
+        int port;
+        std::unique_ptr<client> conn;
+    };
+
+    bool RefreshSlots();
+
+    // Connection to host:port, connecting (again) if needed. The pointer stays valid until Disconnect
+    client *Node(const std::string &host, int port);
+    client *NodeForSlot(int slot);
+
+    void Send(client *target, const std::vector<std::string> &redis_cmd, const reply_callback &callback, int redirects, bool asking);
+    void SendDecoded(client *target, const std::vector<std::string> &redis_cmd, decoder *dec, const decode_callback &callback, int redirects, bool asking);
+
+    // Node to send a command again after a MOVED or ASK error, nullptr for any other error
+    client *Redirect(const char *msg, bool &ask);
+
+    static const std::string *KeyOf(const std::vector<std::string> &redis_cmd);
+
+    std::string password;
+    uint32_t timeout;
+    std::string seed_host;
+    int seed_port;
+
+    mutable std::mutex lock;
+    std::vector<std::unique_ptr<node>> nodes;
+    std::vector<int> slots;     // hash slot -> index of the owning node, -1 if unknown
+
+    // Dropped connections of nodes we connected to again. Workers and redirects may still
+    // hold them, and a redirect can run on their own thread, so they are only freed in Disconnect
+    std::vector<std::unique_ptr<client>> retired;
+
+    std::atomic<bool> refresh;
+};
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "reply.h"
+
+namespace async_redis
+{
+/**
+ * Receives a reply while it is being parsed, instead of having it built as a reply tree
+ *
+ * depth is 0 for the reply itself, 1 for the elements of an array reply and so on,
+ * index is the position of an element in its array.
+ */
+class decoder
+{
+public:
+    virtual ~decoder() = default;
+
+    // Called before every attempt, a redirected command is decoded again
+    virtual void Reset()
+    {
+        error.clear();
+    }
+
+    virtual void Array(int depth, size_t index, size_t elements) {}
+    virtual void String(int depth, size_t index, const char *str, size_t len) {}
+    virtual void Integer(int depth, size_t index, int64_t value) {}
+    virtual void Nil(int depth, size_t index) {}
+
+    // Set when the server replied with an error
+    std::string error;
+};
+
+/**
+ * What the query threads talk to, either a single server (client) or a whole cluster
+ */
+class connection
+{
+public:
+    virtual ~connection() = default;
+
+    virtual bool Connect(const std::string &host, int port, uint32_t timeout_ms) = 0;
+
+    virtual bool IsConnected() const = 0;
+
+    virtual void Disconnect() = 0;
+
+    // reply: actual reply content, nullptr if it could not be sent or received
+    typedef std::function<void(reply *)> reply_callback;
+
+    virtual connection &Append(const std::vector<std::string> &redis_cmd, const reply_callback &callback = nullptr) = 0;
+
+    std::future<std::unique_ptr<reply>> Command(const std::vector<std::string> &redis_cmd, bool commit = true)
+    {
+        auto prms = std::make_shared<std::promise<std::unique_ptr<reply>>>();
+        Append(redis_cmd, [prms](auto r) { prms->set_value(std::unique_ptr<reply>(r)); });
+        if (commit) {
+            Commit();
+        }
+        return prms->get_future();
+    }
+
+    // received: false if it could not be sent or received
+    typedef std::function<void(bool)> decode_callback;
+
+    // The reply is handed to dec as it is read, dec has to stay alive until the callback
+    virtual connection &AppendDecoded(const std::vector<std::string> &redis_cmd, decoder *dec, const decode_callback &callback) = 0;
+
+    std::future<bool> Decode(const std::vector<std::string> &redis_cmd, decoder *dec, bool commit = true)
+    {
+        auto prms = std::make_shared<std::promise<bool>>();
+        AppendDecoded(redis_cmd, dec, [prms](bool received) { prms->set_value(received); });
+        if (commit) {
+            Commit();
+        }
+        return prms->get_future();
+    }
+
+    // If pipeline was enable, it will force worker to commit existing command
+    virtual connection &Commit() = 0;
+
+    // Keys of a single command may only span one hash slot
+    virtual bool IsCluster() const
+    {
+        return false;
+    }
+
+    virtual int GetError() const = 0;
+    virtual const char *GetErrorString() const = 0;
+};
+}
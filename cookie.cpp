@@ -41,8 +41,14 @@ CookieManager::CookieManager()
         connected[i] = false;
         statsLoaded[i] = false;
         statsPending[i] = false;
+        warmLoaded[i] = false;
+        dataVersion[i] = 0;
+        loadAttempts[i] = 0;
+        resyncPending[i] = false;
+        clientData[i].Bind(i, &columns);
     }
 
+    storeClock = 0;
     cookieDataLoadedForward = NULL;
     clientMenu = NULL;
 }
@@ -61,6 +67,17 @@ void CookieManager::Unload()
         delete cookieList[iter];
 
     cookieList.clear();
+    cookieIds.clear();
+    columns.clear();
+    PublishIndexes();
+    pendingCookies.clear();
+    unboundCookies.clear();
+
+    /* Cookies never got an id, there is nowhere to write these values to */
+    for (size_t iter = 0; iter < deferredData.length(); ++iter)
+        deferredData[iter].op->Destroy();
+
+    deferredData.clear();
 }
 
 Cookie *CookieManager::FindCookie(const char *name)
@@ -71,6 +88,14 @@ Cookie *CookieManager::FindCookie(const char *name)
     return cookie;
 }
 
+Cookie *CookieManager::FindCookieById(int dbId)
+{
+    auto iter = cookieIds.find(dbId);
+    if (iter == cookieIds.end())
+        return NULL;
+    return iter->second;
+}
+
 Cookie *CookieManager::CreateCookie(const char *name, const char *description, CookieAccess access)
 {
     Cookie *pCookie = FindCookie(name);
@@ -86,31 +111,246 @@ Cookie *CookieManager::CreateCookie(const char *name, const char *description, C
 
     /* First time cookie - Create from scratch */
     pCookie = new Cookie(name, description, access);
-
-    /* Attempt to insert cookie into the db and get its ID num */
-    TQueryOp *op = new TQueryOp(Query_InsertCookie, pCookie);
-    op->m_params.cookie = pCookie;
+    pCookie->index = cookieList.length();
+    pCookie->maxLength = g_ClientPrefs.maxValueLength;
 
     cookieFinder.insert(name, pCookie);
     cookieList.append(pCookie);
+    columns.emplace_back();
 
-    g_ClientPrefs.AddQueryToQueue(op);
+    /* Inserted into the db with every other cookie registered this frame */
+    pendingCookies.append(pCookie);
 
     return pCookie;
 }
 
+void CookieManager::RegisterPendingCookies()
+{
+    if (pendingCookies.empty()) {
+        return;
+    }
+
+    /* Attempt to insert the cookies into the db and get their ID nums in one go */
+    TQueryOp *op = new TQueryOp(Query_InsertCookie, pendingCookies[0]);
+    for (size_t iter = 0; iter < pendingCookies.length(); ++iter) {
+        op->m_params.cookies.push_back(pendingCookies[iter]);
+    }
+    pendingCookies.clear();
+
+    g_ClientPrefs.AddQueryToQueue(op);
+}
+
+void CookieManager::RetryUnboundCookies()
+{
+    for (size_t iter = 0; iter < unboundCookies.length(); ++iter) {
+        if (unboundCookies[iter]->dbid == -1) {
+            pendingCookies.append(unboundCookies[iter]);
+        }
+    }
+    unboundCookies.clear();
+}
+
+void CookieManager::QueueInsertData(Cookie *pCookie, TQueryOp *op, int prio)
+{
+    /* Hold on to values set before the cookie got its id */
+    if (pCookie->dbid == -1) {
+        /* Only the latest value of a player is kept, it is the one that ends up written anyway */
+        if (op->PullQueryType() == Query_InsertData) {
+            for (size_t iter = 0; iter < deferredData.length(); ++iter) {
+                TQueryOp *older = deferredData[iter].op;
+                if (deferredData[iter].cookie == pCookie && older->PullQueryType() == Query_InsertData
+                    && strcmp(older->m_params.steamId, op->m_params.steamId) == 0) {
+                    older->Destroy();
+                    deferredData.remove(iter);
+                    break;
+                }
+            }
+        }
+
+        deferredData.append(DeferredData{ pCookie, op });
+        return;
+    }
+
+    op->m_params.cookieId = pCookie->dbid;
+    g_ClientPrefs.AddQueryToQueue(op, prio);
+}
+
+void CookieManager::SendBatch(CookieBatch *batch, IChangeableForward *callback, cell_t data)
+{
+    Cookie *pCookie = batch->cookie;
+    BatchWrite *write = new BatchWrite{ callback, data, 0, 0, 0 };
+
+    /* Always at least one query, so the callback never runs from inside the native */
+    TQueryOp *op = NULL;
+    for (auto &[authid, value] : batch->values) {
+        if (op == NULL) {
+            op = new TQueryOp(Query_InsertBatch, pCookie);
+            op->m_params.batch = write;
+            write->pending++;
+        }
+
+        /* Connected players are set in memory, like SetAuthIdCookie does */
+        if (int client = IsAuthIdConnected(authid.c_str())) {
+            SetCookieValue(pCookie, client, value.c_str());
+            write->succeeded++;
+            continue;
+        }
+
+        g_ClientPrefs.warmCache.Evict(authid.c_str());
+        g_ClientPrefs.authIdCache.Evict(authid);
+        op->m_params.values.emplace_back(std::move(authid), std::move(value));
+
+        if (op->m_params.values.size() == BATCH_CHUNK_SIZE) {
+            QueueInsertData(pCookie, op, PrioQueue_Low);
+            op = NULL;
+        }
+    }
+
+    if (op == NULL && write->pending == 0) {
+        op = new TQueryOp(Query_InsertBatch, pCookie);
+        op->m_params.batch = write;
+        write->pending++;
+    }
+
+    if (op != NULL) {
+        QueueInsertData(pCookie, op, PrioQueue_Low);
+    }
+
+    batch->values.clear();
+}
+
+void CookieManager::BatchWriteCallback(BatchWrite *write, size_t succeeded, size_t failed)
+{
+    write->succeeded += succeeded;
+    write->failed += failed;
+
+    if (--write->pending > 0) {
+        return;
+    }
+
+    write->callback->PushCell(write->succeeded);
+    write->callback->PushCell(write->failed);
+    write->callback->PushCell(write->data);
+    write->callback->Execute(NULL);
+
+    forwards->ReleaseForward(write->callback);
+    delete write;
+}
+
+/* Runs the plugin callback of an offline read, a frame action when it did not need a query */
+static void DeliverAuthIdRead(void *data)
+{
+    AuthIdRead *read = (AuthIdRead *)data;
+    IChangeableForward *callback = read->callback;
+
+    callback->PushString(read->authid.c_str());
+
+    if (read->multiple) {
+        /* Null terminated values back to back, like GetClientCookies */
+        std::string packed;
+        std::vector<cell_t> offsets;
+        for (const std::string &value : read->values) {
+            offsets.push_back(packed.size());
+            packed.append(value);
+            packed.push_back('\0');
+        }
+
+        callback->PushStringEx(&packed[0], packed.size(), SM_PARAM_STRING_BINARY | SM_PARAM_STRING_COPY, 0);
+        callback->PushArray(offsets.data(), offsets.size());
+        callback->PushCell(offsets.size());
+    } else {
+        callback->PushCell(read->handle);
+        callback->PushString(read->values[0].c_str());
+    }
+
+    callback->PushCell(read->success);
+    callback->PushCell(read->data);
+    callback->Execute(NULL);
+
+    forwards->ReleaseForward(callback);
+    delete read;
+}
+
+static void StoreAuthIdRows(AuthIdRead *read, const CookieRows &rows)
+{
+    for (const CookieRow &row : rows) {
+        for (size_t i = 0; i < read->cookies.size(); ++i) {
+            if (read->cookies[i]->dbid == row.id) {
+                read->values[i].assign(row.value, 0, read->cookies[i]->maxLength);
+            }
+        }
+    }
+}
+
+void CookieManager::ReadAuthIdCookies(AuthIdRead *read)
+{
+    read->values.resize(read->cookies.size());
+
+    /* Connected players are answered from memory, with the changes not saved yet */
+    int client = IsAuthIdConnected(read->authid.c_str());
+    if (client != 0 && statsLoaded[client]) {
+        for (size_t i = 0; i < read->cookies.size(); ++i) {
+            if (CookieData *data = clientData[client].Find(read->cookies[i]->index)) {
+                read->values[i] = data->value;
+            }
+        }
+
+        read->success = true;
+        g_pSM->AddFrameAction(DeliverAuthIdRead, read);
+        return;
+    }
+
+    /* Cookies without an id have no values stored yet */
+    std::vector<int> ids;
+    for (Cookie *pCookie : read->cookies) {
+        if (pCookie->dbid != -1) {
+            ids.push_back(pCookie->dbid);
+        }
+    }
+
+    CookieRows rows;
+    if (ids.empty() || g_ClientPrefs.authIdCache.Lookup(read->authid, ids, rows)) {
+        StoreAuthIdRows(read, rows);
+
+        read->success = true;
+        g_pSM->AddFrameAction(DeliverAuthIdRead, read);
+        return;
+    }
+
+    TQueryOp *op = new TQueryOp(Query_SelectAuthId, 0);
+    UTIL_strncpy(op->m_params.steamId, read->authid.c_str(), MAX_NAME_LENGTH);
+    op->m_params.cookieIds = std::move(ids);
+    op->m_params.read = read;
+    read->generation = g_ClientPrefs.authIdCache.Generation(read->authid);
+
+    g_ClientPrefs.AddQueryToQueue(op);
+}
+
+void CookieManager::AuthIdReadCallback(AuthIdRead *read, const ParamData &params, CookieRows &rows, bool success)
+{
+    if (success) {
+        /* A replica might not have our own writes yet, a later read has to see them */
+        if (!params.replicated) {
+            g_ClientPrefs.authIdCache.Insert(read->authid, params.cookieIds, rows, read->generation);
+        }
+        StoreAuthIdRows(read, rows);
+    }
+
+    read->success = success;
+    DeliverAuthIdRead(read);
+}
+
 bool CookieManager::GetCookieValue(Cookie *pCookie, int client, char **value)
 {
-    CookieData *data = pCookie->data[client];
+    static char empty[1] = "";
 
-    /* Check if a value has been set before */
+    CookieData *data = clientData[client].Find(pCookie->index);
+
+    /* Cookies without a value are never loaded, don't allocate just to read them */
     if (data == NULL) {
-        data = new CookieData("");
-        data->parent = pCookie;
-        clientData[client].append(data);
-        pCookie->data[client] = data;
-        data->changed = false;
-        data->timestamp = 0;
+        empty[0] = '\0';
+        *value = &empty[0];
+        return true;
     }
 
     *value = &data->value[0];
@@ -118,20 +358,16 @@ bool CookieManager::GetCookieValue(Cookie *pCookie, int client, char **value)
     return true;
 }
 
-bool CookieManager::SetCookieValue(Cookie *pCookie, int client, const char *value)
+CookieData *CookieManager::GetCookieData(Cookie *pCookie, int client)
 {
-    CookieData *data = pCookie->data[client];
+    return clientData[client].Find(pCookie->index);
+}
 
-    if (data == NULL) {
-        data = new CookieData(value);
-        data->parent = pCookie;
-        clientData[client].append(data);
-        pCookie->data[client] = data;
-    } else {
-        UTIL_strncpy(data->value, value, MAX_VALUE_LENGTH);
-    }
+bool CookieManager::SetCookieValue(Cookie *pCookie, int client, const char *value)
+{
+    CookieData *data = clientData[client].Store(pCookie, value);
 
-    data->changed = true;
+    clientData[client].SetChanged(pCookie->index);
     data->timestamp = time(NULL);
 
     return true;
@@ -148,60 +384,136 @@ void CookieManager::OnClientAuthorized(int client, const char *authstring)
     connected[client] = true;
     statsPending[client] = true;
 
-    g_ClientPrefs.AttemptReconnection();
+    /* Late load catch up authorizes clients again, the ids are the same */
+    clientAuthIds[client].clear();
+    for (const char *authid : { player->GetAuthString(), player->GetSteam2Id(), player->GetSteam3Id() }) {
+        if (authid != NULL && authid[0] != '\0') {
+            authIds[authid] = client;
+            clientAuthIds[client].emplace_back(authid);
+        }
+    }
 
     TQueryOp *op = new TQueryOp(Query_SelectData, player->GetSerial());
     UTIL_strncpy(op->m_params.steamId, GetPlayerCompatAuthId(player), MAX_NAME_LENGTH);
 
+    /* Only load cookies registered here, the rest are fetched once their id is known */
+    for (size_t iter = 0; iter < cookieList.length(); ++iter) {
+        if (cookieList[iter]->dbid != -1) {
+            op->m_params.cookieIds.push_back(cookieList[iter]->dbid);
+        }
+    }
+
+    /* Returning players get their values from the warm cache, the query only has to check they are current */
+    if (g_ClientPrefs.warmCache.IsOpen()) {
+        op->m_params.readVersion = true;
+        op->m_params.cachedVersion = LoadFromWarmCache(client, op->m_params.steamId, op->m_params.cookieIds.size());
+    }
+
+    op->m_params.storeClock = storeClock;
+
     g_ClientPrefs.AddQueryToQueue(op);
 }
 
+uint64_t CookieManager::LoadFromWarmCache(int client, const char *authid, size_t registered)
+{
+    WarmCache::values values;
+    uint64_t version;
+    if (!g_ClientPrefs.warmCache.Load(authid, values, version)) {
+        return 0;
+    }
+
+    size_t covered = 0;
+    for (auto &[name, value] : values) {
+        Cookie *parent = FindCookie(name.c_str());
+        if (parent == NULL || parent->dbid == -1) {
+            continue;
+        }
+
+        covered++;
+        if (value.empty() || clientData[client].Find(parent->index) != NULL) {
+            continue;
+        }
+
+        clientData[client].Store(parent, std::move(value));
+    }
+
+    /* Not cached until the load tells whether they are current, see ClientConnectCallback */
+    warmLoaded[client] = true;
+
+    /* Cookies registered since the entry was saved are not in it, they have to be loaded */
+    return covered == registered ? version : 0;
+}
+
 void CookieManager::OnClientDisconnecting(int client)
 {
+    bool loaded = statsLoaded[client];
+
     connected[client] = false;
     statsLoaded[client] = false;
     statsPending[client] = false;
-
-    CookieData *current = NULL;
-
-    g_ClientPrefs.AttemptReconnection();
+    warmLoaded[client] = false;
+    loadAttempts[client] = 0;
+    resyncPending[client] = false;
+    pendingInvalidations[client].clear();
+
+    for (const std::string &authid : clientAuthIds[client]) {
+        auto iter = authIds.find(authid);
+        if (iter != authIds.end() && iter->second == client) {
+            authIds.erase(iter);
+        }
+    }
+    clientAuthIds[client].clear();
 
     /* Save this cookie to the database */
     IGamePlayer *player = playerhelpers->GetGamePlayer(client);
     const char *pAuth = NULL;
-    int dbId;
 
     if (player && !player->IsFakeClient()) {
         pAuth = GetPlayerCompatAuthId(player);
         g_ClientPrefs.ClearQueryCache(player->GetSerial());
+
+        /* Offline reads of this player have to see what is saved now */
+        g_ClientPrefs.authIdCache.Evict(pAuth);
     }
 
-    ke::Vector<CookieData *> &clientvec = clientData[client];
-    for (size_t iter = 0; iter < clientvec.length(); ++iter) {
-        current = clientvec[iter];
-        dbId = current->parent->dbid;
+    ClientValues &values = clientData[client];
+
+    /* Only complete sets of values go to the warm cache, with the version they are known to be at */
+    if (pAuth != NULL && loaded && g_ClientPrefs.warmCache.IsOpen()) {
+        if (dataVersion[client] != 0) {
+            /* Cookies without a value are saved too, a load can tell which cookies the entry covers */
+            WarmCache::values cached;
+            for (size_t index = 0; index < cookieList.length(); ++index) {
+                if (cookieList[index]->dbid != -1) {
+                    CookieData *data = values.Find(index);
+                    cached.emplace_back(cookieList[index]->name, data != NULL ? data->value : std::string());
+                }
+            }
 
-        if (player == NULL || pAuth == NULL || !current->changed || dbId == -1) {
-            current->parent->data[client] = NULL;
-            delete current;
-            continue;
+            g_ClientPrefs.warmCache.Store(pAuth, cached, dataVersion[client]);
+        } else {
+            /* A write was missed while the client was here, the entry could never be validated */
+            g_ClientPrefs.warmCache.Evict(pAuth);
         }
+    }
+    dataVersion[client] = 0;
 
-        TQueryOp *op = new TQueryOp(Query_InsertData, client);
-
-        UTIL_strncpy(op->m_params.steamId, pAuth, MAX_NAME_LENGTH);
-        op->m_params.cookieId = dbId;
-        op->m_params.data = current;
+    /* Only what the plugins changed is written back */
+    if (player != NULL && pAuth != NULL) {
+        values.ForEachChanged([&](size_t index, const CookieData &data) {
+            TQueryOp *op = new TQueryOp(Query_InsertData, client);
 
-        g_ClientPrefs.AddQueryToQueue(op, PrioQueue_High);
+            UTIL_strncpy(op->m_params.steamId, pAuth, MAX_NAME_LENGTH);
+            op->m_params.value = data.value;
 
-        current->parent->data[client] = NULL;
+            QueueInsertData(cookieList[index], op, PrioQueue_High);
+        });
     }
 
-    clientvec.clear();
+    values.Clear();
 }
 
-void CookieManager::ClientConnectCallback(int serial, const std::vector<std::tuple<Cookie, std::string>> &data)
+void CookieManager::ClientConnectCallback(int serial, const ParamData &params, CookieRows &data)
 {
     int client;
 
@@ -209,54 +521,390 @@ void CookieManager::ClientConnectCallback(int serial, const std::vector<std::tup
     if ((client = playerhelpers->GetClientFromSerial(serial)) == 0) {
         return;
     }
+
+    /* The client was unloaded in the meantime, a reload must not mark it as cached */
+    if (params.reload && !statsLoaded[client]) {
+        return;
+    }
     statsPending[client] = false;
 
     // IResultSet *results;
     /* Check validity of results */
 
+    ClientValues &values = clientData[client];
     CookieData *pData;
     // IResultRow *row;
     // unsigned int timestamp;
     // CookieAccess access;
 
-    for (const auto &[cookie, value] : data) {
-        pData = new CookieData(value.data());
-        pData->changed = false;
+    /* Values were taken from the warm cache or loaded before, only apply what changed since */
+    bool validated = params.cachedVersion != 0 && params.version == params.cachedVersion;
+    bool reconcile = (warmLoaded[client] || params.reload) && !validated;
+    warmLoaded[client] = false;
+    loadAttempts[client] = 0;
+    dataVersion[client] = params.version;
+
+    /* Only cookies which were loaded can turn out to have no value */
+    std::vector<bool> missing;
+    if (reconcile) {
+        missing.resize(cookieList.length(), false);
+        for (int id : params.cookieIds) {
+            Cookie *pCookie = FindCookieById(id);
+            if (pCookie != NULL) {
+                missing[pCookie->index] = true;
+            }
+        }
+    }
 
-        pData->timestamp = 0;
+    /* Rows were matched to their cookie on the query thread, see ResolveRows */
+    for (auto &[id, index, value] : data) {
+        if (index >= cookieList.length() || cookieList[index]->dbid != id) {
+            continue;
+        }
+
+        if (reconcile) {
+            missing[index] = false;
+        }
 
-        Cookie *parent = FindCookie(cookie.name);
-        if (parent == NULL) {
-            parent = CreateCookie(cookie.name, cookie.description, cookie.access);
+        if ((pData = values.Find(index)) != NULL) {
+            /* Never overwrite a value the plugins changed or that was stored after the load was queued */
+            if (!values.IsChanged(index) && pData->stored <= params.storeClock && pData->value != value) {
+                values.Store(cookieList[index], std::move(value))->version = params.version;
+            }
+            continue;
         }
 
-        pData->parent = parent;
-        parent->data[client] = pData;
-        clientData[client].append(pData);
+        values.Store(cookieList[index], std::move(value))->version = params.version;
+    }
+
+    /* Only cookies with a value are returned, a cached value missing from the result is gone */
+    if (reconcile) {
+        values.ForEach([&](size_t index, CookieData &data) {
+            if (index < missing.size() && missing[index] && !values.IsChanged(index)
+                && data.stored <= params.storeClock && !data.value.empty()) {
+                values.Store(cookieList[index], std::string());
+            }
+        });
+    }
+
+    /* Writes made elsewhere while we were loading */
+    std::vector<std::string> invalidations = std::move(pendingInvalidations[client]);
+    pendingInvalidations[client].clear();
+    for (const auto &message : invalidations) {
+        ApplyInvalidation(message);
+    }
+
+    /* Plugins were told about the client already */
+    if (params.reload) {
+        return;
     }
 
     statsLoaded[client] = true;
 
+    /* The load might have read the values before the writes that were missed */
+    if (resyncPending[client]) {
+        resyncPending[client] = false;
+        QueueReload(client);
+    }
+
     cookieDataLoadedForward->PushCell(client);
     cookieDataLoadedForward->Execute(NULL);
 }
 
-void CookieManager::InsertCookieCallback(Cookie *pCookie, int dbId)
+void CookieManager::ClientLoadFailed(int serial, const ParamData &params)
+{
+    int client;
+
+    if ((client = playerhelpers->GetClientFromSerial(serial)) == 0) {
+        return;
+    }
+
+    /* The cached values stay, they are just not known to be current anymore */
+    if (params.reload) {
+        dataVersion[client] = 0;
+        return;
+    }
+
+    statsPending[client] = false;
+    resyncPending[client] = false;
+    pendingInvalidations[client].clear();
+
+    /* Load again a few times, a single query can fail while the database is fine */
+    IGamePlayer *player = playerhelpers->GetGamePlayer(client);
+    if (++loadAttempts[client] < MAX_LOAD_ATTEMPTS && player != NULL) {
+        OnClientAuthorized(client, GetPlayerCompatAuthId(player));
+        return;
+    }
+
+    /* Give up and cache the client without values, plugins waiting on it are not left hanging */
+    smutils->LogError(myself, "Could not load the cookies of client %d after %d attempts.", client, loadAttempts[client]);
+    loadAttempts[client] = 0;
+
+    /* Values from the warm cache were never validated, only keep the ones set since */
+    if (warmLoaded[client]) {
+        warmLoaded[client] = false;
+        clientData[client].ForEach([&](size_t index, CookieData &data) {
+            if (!clientData[client].IsChanged(index) && data.stored == 0) {
+                clientData[client].Store(cookieList[index], std::string());
+            }
+        });
+    }
+    dataVersion[client] = 0;
+
+    statsLoaded[client] = true;
+
+    cookieDataLoadedForward->PushCell(client);
+    cookieDataLoadedForward->Execute(NULL);
+}
+
+void CookieManager::CookieDataCallback(Cookie *pCookie, CookieRows &data)
+{
+    int client;
+
+    for (CookieRow &row : data) {
+        if ((client = playerhelpers->GetClientFromSerial(row.id)) == 0 || !connected[client]) {
+            continue;
+        }
+
+        /* Never overwrite a value the plugins changed in the meantime */
+        if (!clientData[client].IsChanged(pCookie->index)) {
+            clientData[client].Store(pCookie, std::move(row.value))->stored = ++storeClock;
+        }
+    }
+}
+
+void CookieManager::ApplyInvalidation(const std::string &message)
+{
+    /* "origin version id steamid +value" or "origin version id steamid -" */
+    size_t fields[4];
+    size_t pos = 0;
+    for (int i = 0; i < 4; ++i) {
+        if ((pos = message.find(' ', pos)) == std::string::npos) {
+            return;
+        }
+        fields[i] = pos++;
+    }
+
+    /* Our own writes only move the versions along */
+    bool own = message.compare(0, fields[0], g_ClientPrefs.invalidationOrigin) == 0;
+    uint64_t version = strtoull(message.c_str() + fields[0] + 1, NULL, 10);
+
+    /* Cookies not registered here still count for the version */
+    Cookie *pCookie = FindCookieById(atoi(message.c_str() + fields[1] + 1));
+
+    std::string authid = message.substr(fields[2] + 1, fields[3] - fields[2] - 1);
+    bool hasValue = message[fields[3] + 1] == '+';
+    const char *value = message.c_str() + fields[3] + 2;
+
+    int client = IsAuthIdConnected(authid.c_str());
+    if (client == 0 || !connected[client]) {
+        g_ClientPrefs.authIdCache.Evict(authid);
+
+        /* Keep the warm cache in line for players who are not here */
+        if (!g_ClientPrefs.warmCache.IsOpen()) {
+            return;
+        }
+
+        WarmCache::values values;
+        uint64_t cached;
+        if (!g_ClientPrefs.warmCache.Load(authid.c_str(), values, cached) || version <= cached) {
+            return;
+        }
+
+        /* A write in between was missed, or the value has to be fetched */
+        if (version != cached + 1 || (pCookie != NULL && !hasValue)) {
+            g_ClientPrefs.warmCache.Evict(authid.c_str());
+            return;
+        }
+
+        if (pCookie != NULL) {
+            bool found = false;
+            for (auto &[name, current] : values) {
+                if (strcmp(name.c_str(), pCookie->name) == 0) {
+                    current = value;
+                    found = true;
+                    break;
+                }
+            }
+
+            if (!found) {
+                values.emplace_back(pCookie->name, value);
+            }
+        }
+
+        g_ClientPrefs.warmCache.Store(authid.c_str(), values, version);
+        return;
+    }
+
+    /* The values of the client are at a known version only while every write is applied in order */
+    if (version > dataVersion[client]) {
+        bool follows = dataVersion[client] != 0 && version == dataVersion[client] + 1;
+        dataVersion[client] = follows && !own && (hasValue || pCookie == NULL) ? version : 0;
+    }
+
+    if (own || pCookie == NULL) {
+        return;
+    }
+
+    /* Replays and writes relayed out of order must not undo a newer one */
+    CookieData *data = clientData[client].Find(pCookie->index);
+    if (data != NULL && version < data->version) {
+        return;
+    }
+
+    /* The load in flight might predate this write, apply it again once it is done */
+    if (statsPending[client]) {
+        pendingInvalidations[client].push_back(message);
+    }
+
+    if (!hasValue) {
+        if (data != NULL) {
+            data->version = version;
+        }
+
+        IGamePlayer *player = playerhelpers->GetGamePlayer(client);
+        TQueryOp *op = new TQueryOp(Query_SelectCookie, pCookie);
+        op->m_params.cookieId = pCookie->dbid;
+        op->m_params.players.emplace_back(player->GetSerial(), GetPlayerCompatAuthId(player));
+        g_ClientPrefs.AddQueryToQueue(op);
+        return;
+    }
+
+    /* Local changes win, they are written back on disconnect */
+    if (!clientData[client].IsChanged(pCookie->index)) {
+        data = clientData[client].Store(pCookie, value);
+        data->stored = ++storeClock;
+        data->version = version;
+    }
+}
+
+void CookieManager::ResyncClients()
+{
+    int maxClients = playerhelpers->GetMaxClients();
+    for (int client = 1; client <= maxClients; client++) {
+        if (statsLoaded[client]) {
+            QueueReload(client);
+        } else if (statsPending[client]) {
+            resyncPending[client] = true;
+        }
+    }
+}
+
+void CookieManager::QueueReload(int client)
 {
-    if (dbId > 0) {
-        pCookie->dbid = dbId;
+    IGamePlayer *player = playerhelpers->GetGamePlayer(client);
+    if (player == NULL || player->IsFakeClient()) {
         return;
     }
 
-    TQueryOp *op = new TQueryOp(Query_SelectId, pCookie);
-    /* Put the cookie name into the steamId field to save space - Make sure we remember that it's there */
-    UTIL_strncpy(op->m_params.steamId, pCookie->name, MAX_NAME_LENGTH);
+    TQueryOp *op = new TQueryOp(Query_SelectData, player->GetSerial());
+    UTIL_strncpy(op->m_params.steamId, GetPlayerCompatAuthId(player), MAX_NAME_LENGTH);
+
+    for (size_t iter = 0; iter < cookieList.length(); ++iter) {
+        if (cookieList[iter]->dbid != -1) {
+            op->m_params.cookieIds.push_back(cookieList[iter]->dbid);
+        }
+    }
+
+    /* Nothing is loaded if the version did not move, unless a write was already missed */
+    op->m_params.readVersion = true;
+    op->m_params.cachedVersion = dataVersion[client];
+    op->m_params.storeClock = storeClock;
+    op->m_params.reload = true;
+
     g_ClientPrefs.AddQueryToQueue(op);
 }
 
-void CookieManager::SelectIdCallback(Cookie *pCookie, int dbId)
+void CookieManager::ResolveRows(CookieRows &rows) const
+{
+    std::shared_ptr<const IndexMap> snapshot = std::atomic_load(&indexes);
+    if (!snapshot) {
+        return;
+    }
+
+    for (CookieRow &row : rows) {
+        auto iter = snapshot->find(row.id);
+        if (iter != snapshot->end()) {
+            row.index = iter->second;
+        }
+    }
+}
+
+void CookieManager::PublishIndexes()
+{
+    auto snapshot = std::make_shared<IndexMap>();
+    snapshot->reserve(cookieIds.size());
+    for (const auto &[dbId, pCookie] : cookieIds) {
+        (*snapshot)[dbId] = pCookie->index;
+    }
+
+    std::atomic_store(&indexes, std::shared_ptr<const IndexMap>(std::move(snapshot)));
+}
+
+void CookieManager::BindCookieId(Cookie *pCookie, int dbId)
 {
     pCookie->dbid = dbId;
+    cookieIds[dbId] = pCookie;
+
+    for (size_t iter = 0; iter < deferredData.length(); ++iter) {
+        if (deferredData[iter].cookie == pCookie) {
+            QueueInsertData(pCookie, deferredData[iter].op, PrioQueue_High);
+            deferredData.remove(iter--);
+        }
+    }
+
+    /* Registered after these players were loaded, fetch their values for it now */
+    TQueryOp *op = NULL;
+    IGamePlayer *player;
+
+    for (int i = playerhelpers->GetMaxClients() + 1; --i > 0;) {
+        if (!connected[i] || (player = playerhelpers->GetGamePlayer(i)) == NULL) {
+            continue;
+        }
+
+        if (op == NULL) {
+            op = new TQueryOp(Query_SelectCookie, pCookie);
+            op->m_params.cookieId = dbId;
+        }
+
+        op->m_params.players.emplace_back(player->GetSerial(), GetPlayerCompatAuthId(player));
+    }
+
+    if (op != NULL) {
+        g_ClientPrefs.AddQueryToQueue(op);
+    }
+}
+
+void CookieManager::InsertCookieCallback(const std::vector<Cookie *> &cookies, const std::vector<int> &dbIds)
+{
+    for (size_t i = 0; i < cookies.size(); ++i) {
+        Cookie *pCookie = cookies[i];
+
+        if (i < dbIds.size() && dbIds[i] > 0) {
+            BindCookieId(pCookie, dbIds[i]);
+            continue;
+        }
+
+        TQueryOp *op = new TQueryOp(Query_SelectId, pCookie);
+        /* Put the cookie name into the steamId field to save space - Make sure we remember that it's there */
+        UTIL_strncpy(op->m_params.steamId, pCookie->name, MAX_NAME_LENGTH);
+        g_ClientPrefs.AddQueryToQueue(op);
+    }
+
+    /* Once for every cookie registered this frame */
+    PublishIndexes();
+}
+
+void CookieManager::SelectIdCallback(Cookie *pCookie, int dbId)
+{
+    /* Its values stay deferred until a later registration gets the id */
+    if (dbId <= 0) {
+        unboundCookies.append(pCookie);
+        return;
+    }
+
+    BindCookieId(pCookie, dbId);
+    PublishIndexes();
 }
 
 bool CookieManager::AreClientCookiesCached(int client)
@@ -264,11 +912,31 @@ bool CookieManager::AreClientCookiesCached(int client)
     return statsLoaded[client];
 }
 
+int CookieManager::FindClientByAuthId(const char *authid) const
+{
+    auto iter = authIds.find(authid);
+    return iter != authIds.end() ? iter->second : 0;
+}
+
 bool CookieManager::AreClientCookiesPending(int client)
 {
     return statsPending[client];
 }
 
+void CookieManager::AppendMenuItem(AutoMenuData *data, const ItemDrawInfo &draw)
+{
+    char info[20];
+    g_pSM->Format(info, sizeof(info), "%x", data);
+
+    clientMenu->AppendItem(info, draw);
+    menuData.push_back(data);
+}
+
+AutoMenuData *CookieManager::GetMenuData(unsigned int item)
+{
+    return menuData[item];
+}
+
 void CookieManager::OnPluginDestroyed(IPlugin *plugin)
 {
     ke::Vector<char *> *pList;
@@ -293,7 +961,14 @@ void CookieManager::OnPluginDestroyed(IPlugin *plugin)
                 }
 
                 if (strcmp(draw.display, name) == 0) {
-                    data = (AutoMenuData *)strtoul(info, NULL, 16);
+                    data = menuData[i];
+
+                    /* Someone may have the auto menu of this item open */
+                    for (int client = 1; client <= SM_MAXPLAYERS; client++) {
+                        if (g_AutoHandler.selection[client] == data) {
+                            g_AutoHandler.selection[client] = NULL;
+                        }
+                    }
 
                     if (data->handler->forward != NULL) {
                         forwards->ReleaseForward(data->handler->forward);
@@ -302,6 +977,7 @@ void CookieManager::OnPluginDestroyed(IPlugin *plugin)
                     delete data;
 
                     clientMenu->RemoveItem(i);
+                    menuData.erase(menuData.begin() + i);
                     break;
                 }
             }
@@ -315,7 +991,7 @@ void CookieManager::OnPluginDestroyed(IPlugin *plugin)
 
 bool CookieManager::GetCookieTime(Cookie *pCookie, int client, time_t *value)
 {
-    CookieData *data = pCookie->data[client];
+    CookieData *data = clientData[client].Find(pCookie->index);
 
     /* Check if a value has been set before */
     if (data == NULL) {
@@ -35,11 +35,18 @@
 #include "extension.h"
 #include "am-vector.h"
 #include <sm_namehashset.h>
+#include "cookierow.h"
 
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <string>
-#include <tuple>
+#include <algorithm>
+#include <memory>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #define MAX_NAME_LENGTH 30
 #define MAX_DESC_LENGTH 255
@@ -53,18 +60,74 @@ enum CookieAccess
 };
 
 struct Cookie;
+struct AutoMenuData;
+class TQueryOp;
+struct ParamData;
 
+/* Short values ("0", "1") are kept inline by std::string, only long ones are allocated */
 struct CookieData
 {
-	CookieData(const char *value)
+	void Assign(std::string &&value)
+	{
+		this->value = std::move(value);
+		parsed = 0;
+	}
+
+	/* Typed reads parse the value once, until it changes */
+	int AsInt()
+	{
+		if (!(parsed & Parsed_Int))
+		{
+			intValue = strtol(value.c_str(), NULL, 10);
+			parsed |= Parsed_Int;
+		}
+		return intValue;
+	}
+
+	float AsFloat()
+	{
+		if (!(parsed & Parsed_Float))
+		{
+			floatValue = (float)atof(value.c_str());
+			parsed |= Parsed_Float;
+		}
+		return floatValue;
+	}
+
+	/* Understands the values stored by the prefab menus too */
+	bool AsBool()
 	{
-		UTIL_strncpy(this->value, value, MAX_VALUE_LENGTH);
+		if (!(parsed & Parsed_Bool))
+		{
+			const char *str = value.c_str();
+			if (strcmp(str, "yes") == 0 || strcmp(str, "on") == 0 || strcmp(str, "true") == 0)
+				boolValue = true;
+			else if (strcmp(str, "no") == 0 || strcmp(str, "off") == 0 || strcmp(str, "false") == 0)
+				boolValue = false;
+			else
+				boolValue = AsInt() != 0;
+			parsed |= Parsed_Bool;
+		}
+		return boolValue;
 	}
 
-	char value[MAX_VALUE_LENGTH+1];
-	bool changed;
+	enum
+	{
+		Parsed_Int = (1<<0),
+		Parsed_Float = (1<<1),
+		Parsed_Bool = (1<<2),
+	};
+
+	std::string value;
 	time_t timestamp;
-	Cookie *parent;
+	/* CookieManager::storeClock when stored outside of a player load, 0 otherwise */
+	uint64_t stored;
+	/* Version of the player's values this one was loaded or published at, 0 if unknown */
+	uint64_t version;
+	uint8_t parsed;
+	bool boolValue;
+	int intValue;
+	float floatValue;
 };
 
 struct Cookie
@@ -77,24 +140,17 @@ struct Cookie
 		this->access = access;
 
 		dbid = -1;
-
-		for (int i=0; i<=SM_MAXPLAYERS; i++)
-			data[i] = NULL;
-	}
-
-	~Cookie()
-	{
-		for (int i=0; i<=SM_MAXPLAYERS; i++)
-		{
-			if (data[i] != NULL)
-				delete data[i];
-		}
+		index = 0;
+		maxLength = MAX_VALUE_LENGTH;
 	}
 
 	char name[MAX_NAME_LENGTH+1];
 	char description[MAX_DESC_LENGTH+1];
 	int dbid;
-	CookieData *data[SM_MAXPLAYERS+1];
+	/* Position in the cookie list, values of every client are stored by it */
+	size_t index;
+	/* Longer values are truncated */
+	size_t maxLength;
 	CookieAccess access;
 
 	static inline bool matches(const char *name, const Cookie *cookie)
@@ -107,6 +163,205 @@ struct Cookie
 	}
 };
 
+/* The parsed value of one cookie for every client, indexed by client, for the column natives */
+struct CookieColumn
+{
+	CookieColumn() : ints(SM_MAXPLAYERS+1, 0), floats(SM_MAXPLAYERS+1, 0.0f), set(SM_MAXPLAYERS+1, 0)
+	{
+	}
+
+	void Update(int client, const std::string &value)
+	{
+		set[client] = !value.empty();
+		ints[client] = set[client] ? strtol(value.c_str(), NULL, 10) : 0;
+		floats[client] = set[client] ? (float)atof(value.c_str()) : 0.0f;
+	}
+
+	std::vector<int> ints;
+	std::vector<float> floats;
+	/* Whether the client has a value which is not empty */
+	std::vector<uint8_t> set;
+};
+
+/* The values of a single client, stored by Cookie::index with a bit per cookie for present and changed */
+class ClientValues
+{
+public:
+	ClientValues() : client(0), columns(NULL)
+	{
+	}
+
+	/* Every value stored is mirrored into the column of its cookie, at the position of client */
+	void Bind(int client, std::vector<CookieColumn> *columns)
+	{
+		this->client = client;
+		this->columns = columns;
+	}
+
+	CookieData *Find(size_t index)
+	{
+		return Test(present, index) ? &values[index] : NULL;
+	}
+
+	/* Sets the value without touching the changed bit */
+	CookieData *Store(const Cookie *cookie, std::string &&value)
+	{
+		size_t index = cookie->index;
+		if (index >= values.size())
+		{
+			values.resize(index + 1);
+			present.resize(index / 64 + 1, 0);
+			changed.resize(index / 64 + 1, 0);
+		}
+
+		if (!Test(present, index))
+		{
+			present[index / 64] |= Bit(index);
+			values[index].timestamp = 0;
+			values[index].stored = 0;
+			values[index].version = 0;
+		}
+
+		if (value.size() > cookie->maxLength)
+		{
+			value.resize(cookie->maxLength);
+		}
+
+		values[index].Assign(std::move(value));
+		Mirror(index);
+		return &values[index];
+	}
+
+	CookieData *Store(const Cookie *cookie, const char *value)
+	{
+		return Store(cookie, std::string(value, strnlen(value, cookie->maxLength)));
+	}
+
+	bool IsChanged(size_t index) const
+	{
+		return Test(changed, index);
+	}
+
+	void SetChanged(size_t index)
+	{
+		changed[index / 64] |= Bit(index);
+	}
+
+	/* Drops every value at once, the slots are kept for the next client but long values are freed */
+	void Clear()
+	{
+		Walk(present, [this](size_t index, CookieData &data) {
+			std::string().swap(data.value);
+			Mirror(index);
+		});
+
+		std::fill(present.begin(), present.end(), 0);
+		std::fill(changed.begin(), changed.end(), 0);
+	}
+
+	template <typename F>
+	void ForEach(F func)
+	{
+		Walk(present, func);
+	}
+
+	template <typename F>
+	void ForEachChanged(F func)
+	{
+		Walk(changed, func);
+	}
+
+private:
+	void Mirror(size_t index)
+	{
+		if (columns != NULL && index < columns->size())
+		{
+			(*columns)[index].Update(client, values[index].value);
+		}
+	}
+
+	static inline uint64_t Bit(size_t index)
+	{
+		return (uint64_t)1 << (index % 64);
+	}
+
+	static inline bool Test(const std::vector<uint64_t> &bits, size_t index)
+	{
+		return index / 64 < bits.size() && (bits[index / 64] & Bit(index)) != 0;
+	}
+
+	template <typename F>
+	void Walk(const std::vector<uint64_t> &bits, F func)
+	{
+		for (size_t word = 0; word < bits.size(); word++)
+		{
+			for (uint64_t set = bits[word]; set != 0; set &= set - 1)
+			{
+				size_t index = word * 64 + LowestBit(set);
+				func(index, values[index]);
+			}
+		}
+	}
+
+	static inline size_t LowestBit(uint64_t set)
+	{
+#ifdef _MSC_VER
+		unsigned long bit;
+		_BitScanForward64(&bit, set);
+		return bit;
+#else
+		return __builtin_ctzll(set);
+#endif
+	}
+
+	std::vector<CookieData> values;
+	std::vector<uint64_t> present;
+	std::vector<uint64_t> changed;
+	int client;
+	std::vector<CookieColumn> *columns;
+};
+
+/* Values for players who may not be connected, filled by a plugin and then sent as a whole */
+struct CookieBatch
+{
+	Cookie *cookie;
+	/* Auth id and value */
+	std::vector<std::pair<std::string, std::string>> values;
+};
+
+/* A sent batch, written in chunks by several queries with a single callback at the end */
+struct BatchWrite
+{
+	IChangeableForward *callback;
+	cell_t data;
+	size_t pending;
+	size_t succeeded;
+	size_t failed;
+};
+
+/* A read of a player who does not have to be connected, answered through a plugin callback */
+struct AuthIdRead
+{
+	IChangeableForward *callback;
+	cell_t data;
+	/* GetAuthIdCookiesAsync, the single cookie callback gets the cookie handle instead */
+	bool multiple;
+	cell_t handle;
+	std::string authid;
+	std::vector<Cookie *> cookies;
+	/* The value of every cookie, in the order they were asked for */
+	std::vector<std::string> values;
+	/* AuthIdCache generation of the player when the query was queued */
+	uint64_t generation;
+	bool success;
+};
+
+/* Writes pipelined by a single query */
+#define BATCH_CHUNK_SIZE 1000
+
+/* Loads of a client tried before it is cached without values */
+#define MAX_LOAD_ATTEMPTS 3
+
 class CookieManager : public IClientListener, public IPluginsListener
 {
 public:
@@ -119,33 +374,129 @@ public:
 	bool GetCookieValue(Cookie *pCookie, int client, char **value);
 	bool SetCookieValue(Cookie *pCookie, int client, const char *value);
 	bool GetCookieTime(Cookie *pCookie, int client, time_t *value);
+	/* NULL if the client has no value */
+	CookieData *GetCookieData(Cookie *pCookie, int client);
+
+	/* Every cookie the client has a value for */
+	template <typename F>
+	void ForEachCookieData(int client, F func)
+	{
+		clientData[client].ForEach([&](size_t index, CookieData &data) {
+			func(cookieList[index], data);
+		});
+	}
+
+	/* The value of a cookie for every client whose cookies are loaded, NULL if the client has none */
+	template <typename F>
+	void ForEachClientData(Cookie *pCookie, F func)
+	{
+		int maxClients = playerhelpers->GetMaxClients();
+		for (int client = 1; client <= maxClients; client++)
+		{
+			if (statsLoaded[client])
+			{
+				func(client, clientData[client].Find(pCookie->index));
+			}
+		}
+	}
+
+	/* Only meaningful for the clients whose cookies are cached */
+	const CookieColumn &GetColumn(Cookie *pCookie) const
+	{
+		return columns[pCookie->index];
+	}
 
 	void Unload();
 
-	void ClientConnectCallback(int serial, const std::vector<std::tuple<Cookie, std::string>> &data);
-	void InsertCookieCallback(Cookie *pCookie, int dbId);
+	/* params of the SelectData query, data is empty when the values from the warm cache were current */
+	void ClientConnectCallback(int serial, const ParamData &params, CookieRows &data);
+	void ClientLoadFailed(int serial, const ParamData &params);
+	void CookieDataCallback(Cookie *pCookie, CookieRows &data);
+	void InsertCookieCallback(const std::vector<Cookie *> &cookies, const std::vector<int> &dbIds);
 	void SelectIdCallback(Cookie *pCookie, int dbId);
 	Cookie *FindCookie(const char *name);
+	Cookie *FindCookieById(int dbId);
 	Cookie *CreateCookie(const char *name, const char *description, CookieAccess access);
+	void RegisterPendingCookies();
+	/* Registers the cookies which could not get an id again */
+	void RetryUnboundCookies();
+	void ApplyInvalidation(const std::string &message);
+	/* Invalidations were missed, reloads every client whose values moved in the meantime */
+	void ResyncClients();
+	void ResolveRows(CookieRows &rows) const;
+	void QueueInsertData(Cookie *pCookie, TQueryOp *op, int prio = PrioQueue_Normal);
+	void SendBatch(CookieBatch *batch, IChangeableForward *callback, cell_t data);
+	void BatchWriteCallback(BatchWrite *write, size_t succeeded, size_t failed);
+	void ReadAuthIdCookies(AuthIdRead *read);
+	void AuthIdReadCallback(AuthIdRead *read, const ParamData &params, CookieRows &rows, bool success);
 
 	bool AreClientCookiesCached(int client);
 
+	/* Adds an item to the settings menu, its data is found by position from then on */
+	void AppendMenuItem(AutoMenuData *data, const ItemDrawInfo &draw);
+	AutoMenuData *GetMenuData(unsigned int item);
+
+	/* The connected client using this auth id in any of its forms, 0 if there is none */
+	int FindClientByAuthId(const char *authid) const;
+
 	void OnPluginDestroyed(IPlugin *plugin);
 	
 	bool AreClientCookiesPending(int client);
 
+private:
+	/* Version to validate the values against, 0 if they do not cover every registered cookie */
+	uint64_t LoadFromWarmCache(int client, const char *authid, size_t registered);
+	void QueueReload(int client);
+	void BindCookieId(Cookie *pCookie, int dbId);
+	void PublishIndexes();
+
 public:
 	IForward *cookieDataLoadedForward;
 	ke::Vector<Cookie *> cookieList;
 	IBaseMenu *clientMenu;
+	/* Data of every item of the settings menu, in the same order */
+	std::vector<AutoMenuData *> menuData;
 
 private:
 	NameHashSet<Cookie *> cookieFinder;
-	ke::Vector<CookieData *> clientData[SM_MAXPLAYERS+1];
+	std::unordered_map<int, Cookie *> cookieIds;
+
+	/* Cookie id -> Cookie::index for the query threads, replaced as a whole and never modified */
+	typedef std::unordered_map<int, size_t> IndexMap;
+	std::shared_ptr<const IndexMap> indexes;
+
+	struct DeferredData
+	{
+		Cookie *cookie;
+		TQueryOp *op;
+	};
+
+	ke::Vector<Cookie *> pendingCookies;
+	/* Registration failed, tried again on map start and once the database is back */
+	ke::Vector<Cookie *> unboundCookies;
+	ke::Vector<DeferredData> deferredData;
+	ClientValues clientData[SM_MAXPLAYERS+1];
+	/* Parsed values by Cookie::index, filled by clientData */
+	std::vector<CookieColumn> columns;
 
 	bool connected[SM_MAXPLAYERS+1];
 	bool statsLoaded[SM_MAXPLAYERS+1];
 	bool statsPending[SM_MAXPLAYERS+1];
+	/* Values taken from the warm cache, not validated by the load yet */
+	bool warmLoaded[SM_MAXPLAYERS+1];
+	/* Version in Redis the values of the client are at, 0 once a write was missed */
+	uint64_t dataVersion[SM_MAXPLAYERS+1];
+	/* Bumped by every value stored outside of a player load, a load queued before it is older */
+	uint64_t storeClock;
+	/* Failed loads of the client in a row */
+	int loadAttempts[SM_MAXPLAYERS+1];
+	/* Invalidations were missed while the client was loading, reloaded once the load is done */
+	bool resyncPending[SM_MAXPLAYERS+1];
+	std::vector<std::string> pendingInvalidations[SM_MAXPLAYERS+1];
+
+	/* AuthString, Steam2 and Steam3 id of every connected client -> client index */
+	std::unordered_map<std::string, int> authIds;
+	std::vector<std::string> clientAuthIds[SM_MAXPLAYERS+1];
 };
 
 extern CookieManager g_CookieManager;
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+/**
+ * A value read from Redis, on its way to the main thread
+ *
+ * The id is the cookie id for player loads and the client serial for single cookie
+ * loads. Rows are built in place by the reply decoders and can only be moved.
+ *
+ * Player loads also get the local index of their cookie on the query thread, so the
+ * main thread does not have to look anything up.
+ */
+struct CookieRow
+{
+    static constexpr size_t Unresolved = SIZE_MAX;
+
+    CookieRow(int id, std::string &&value) : id(id), index(Unresolved), value(std::move(value))
+    {
+    }
+
+    CookieRow(CookieRow &&) = default;
+    CookieRow &operator=(CookieRow &&) = default;
+
+    CookieRow(const CookieRow &) = delete;
+    CookieRow &operator=(const CookieRow &) = delete;
+
+    int id;
+    size_t index;
+    std::string value;
+};
+
+typedef std::vector<CookieRow> CookieRows;
@@ -36,6 +36,8 @@
 #include <thread>
 #include <string>
 #include <vector>
+#include <random>
+#include <sstream>
 #include <intrin.h>
 
 using namespace ke;
@@ -54,6 +56,13 @@ CookieTypeHandler g_CookieTypeHandler;
 
 HandleType_t g_CookieIterator = 0;
 CookieIteratorHandler g_CookieIteratorHandler;
+HandleType_t g_CookieBatchType = 0;
+CookieBatchHandler g_CookieBatchHandler;
+
+void CookieBatchHandler::OnHandleDestroy(HandleType_t type, void *object)
+{
+    delete (CookieBatch *)object;
+}
 DbDriver g_DriverType;
 
 long volatile worker_exit = 0;
@@ -112,12 +121,121 @@ bool ClientPrefs::SDK_OnLoad(char *error, size_t maxlength, bool late)
     smutils->LogMessage(myself, "Connecting to %s:%d %s password using %d query thread(s).",
         host.c_str(), port, pass.empty() ? "without" : "with", worker);
 
+    const char *warm_entries = smutils->GetCoreConfigValue("RedisWarmCache");
+    if (warm_entries && atoi(warm_entries) > 0) {
+        const char *entry_size = smutils->GetCoreConfigValue("RedisWarmCacheEntrySize");
+        const char *max_age = smutils->GetCoreConfigValue("RedisWarmCacheMaxAge");
+
+        char path[PLATFORM_MAX_PATH];
+        smutils->BuildPath(Path_SM, path, sizeof(path), "data/clientprefs-redis.cache");
+
+        if (!warmCache.Open(path,
+            atoi(warm_entries),
+            entry_size ? atoi(entry_size) : 16384,
+            max_age ? atoi(max_age) : 86400)) {
+            smutils->LogError(myself, "Could not open warm cache \"%s\" (in use by another server?), continuing without it.", path);
+        }
+    }
+
+    const char *packed_load = smutils->GetCoreConfigValue("RedisPackedLoad");
+    packedLoad = packed_load == nullptr || atoi(packed_load) > 0;
+
+    const char *max_length = smutils->GetCoreConfigValue("RedisMaxValueLength");
+    maxValueLength = max_length && atoi(max_length) > 0 ? atoi(max_length) : MAX_VALUE_LENGTH;
+
+    const char *authid_ttl = smutils->GetCoreConfigValue("RedisAuthIdCacheTTL");
+    authIdCache.SetTTL(authid_ttl && atoi(authid_ttl) >= 0 ? atoi(authid_ttl) : 5000);
+
+    const char *use_cluster = smutils->GetCoreConfigValue("RedisCluster");
+    cluster = use_cluster && atoi(use_cluster) > 0;
+
+    const char *replica_list = smutils->GetCoreConfigValue("RedisReplicas");
+    if (replica_list && cluster) {
+        smutils->LogError(myself, "RedisReplicas is not supported with RedisCluster, loading from the primaries.");
+    } else if (replica_list) {
+        // "host:port host:port ...", query threads are spread over them
+        std::istringstream stream(replica_list);
+        for (std::string endpoint; stream >> endpoint;) {
+            size_t colon = endpoint.rfind(':');
+            if (colon == std::string::npos) {
+                replicas.push_back({ endpoint, port });
+            } else {
+                replicas.push_back({ endpoint.substr(0, colon), atoi(endpoint.c_str() + colon + 1) });
+            }
+        }
+
+        smutils->LogMessage(myself, "Loading players from %d replica(s).", (int)replicas.size());
+    }
+
+    const char *use_invalidation = smutils->GetCoreConfigValue("RedisInvalidation");
+    invalidation = use_invalidation && atoi(use_invalidation) > 0;
+
+    const char *use_tracking = smutils->GetCoreConfigValue("RedisTracking");
+    tracking = use_tracking && atoi(use_tracking) > 0;
+
+    if (tracking && cluster) {
+        // Tracking only covers the keys of the node we are subscribed to
+        smutils->LogError(myself, "RedisTracking is not supported with RedisCluster, the value cache is disabled.");
+        tracking = false;
+    }
+
+    std::vector<std::string> channels;
+    std::vector<std::string> prefixes;
+
+    if (invalidation) {
+        std::random_device rd;
+        char origin[20];
+        ke::SafeSprintf(origin, sizeof(origin), "%08x%08x", rd(), rd());
+
+        invalidationOrigin = origin;
+        invalidationChannel = "cookies.invalidate." + std::to_string(dbid);
+        channels.push_back(invalidationChannel);
+    }
+
+    if (tracking) {
+        const char *cache_size = smutils->GetCoreConfigValue("RedisTrackingCacheSize");
+        valueCache.SetCapacity(cache_size ? atoi(cache_size) : 4096);
+
+        // Player keys are "<auth id>.<cookie id>", track every auth id format we may store
+        const char *tracking_prefixes = smutils->GetCoreConfigValue("RedisTrackingPrefixes");
+        std::istringstream stream(tracking_prefixes ? tracking_prefixes : "STEAM_ [U:");
+        for (std::string prefix; stream >> prefix;) {
+            prefixes.push_back(prefix);
+        }
+
+        channels.push_back("__redis__:invalidate");
+    }
+
+    if (!channels.empty()) {
+        subscriber.Start(host, port, pass, channels, [this](const std::string &channel, const std::string &message) {
+            if (channel != "__redis__:invalidate") {
+                invalidations.enqueue(message);
+            } else if (message.empty()) {
+                valueCache.Clear();
+            } else {
+                valueCache.Invalidate(message);
+            }
+        }, prefixes, [this, first = true]() mutable {
+            // We were not listening for a while, anything cached might be outdated
+            valueCache.Clear();
+
+            if (!first && invalidation) {
+                resubscribed = true;
+            }
+            first = false;
+        });
+    }
+
     for (int i = 0; i < worker; ++i) {
         std::thread([this, i, onlylua] {
-            async_redis::client *db = nullptr;
+            async_redis::connection *db = nullptr;
             auto connectDb = [&]() {
                 while (!db || !db->IsConnected()) {
-                    db = new async_redis::client();
+                    if (cluster) {
+                        db = new async_redis::cluster(pass);
+                    } else {
+                        db = new async_redis::client();
+                    }
 
                     Sleep(3000);
                     if (db->Connect(host, port, maxTimeout)) {
@@ -128,30 +246,77 @@ bool ClientPrefs::SDK_OnLoad(char *error, size_t maxlength, bool late)
                     db = nullptr;
                 }
 
-                auto reply = db->Command({ "AUTH", pass }).get();
-                if (!reply || !reply->IsStatus()) {
-                    fprintf(stderr, "REDIS ERROR: %s\n", reply->Status());
-                    return;
+                // Cluster nodes are authenticated as they are connected, and only have database 0
+                if (!pass.empty() && !cluster) {
+                    auto reply = db->Command({ "AUTH", pass }).get();
+                    if (!reply || !reply->IsStatus()) {
+                        fprintf(stderr, "REDIS ERROR: %s\n", reply ? reply->Status() : "no reply");
+                        return;
+                    }
                 }
 
-                db->Append({ "SELECT", std::to_string(dbid) }).Commit();
+                if (!cluster) {
+                    db->Append({ "SELECT", std::to_string(dbid) }).Commit();
+                }
 
-                reply = db->Command({ "SCRIPT", "LOAD", GET_CLIENT_COOKIES }).get();
-                if (!reply) {
-                    fprintf(stderr, "Invalid reply when loading lua script\n");
-                    return;
+                static const char *scripts[][2] = {
+                    { GET_CLIENT_COOKIES, GET_CLIENT_COOKIES_SHA },
+                    { GET_CLIENT_COOKIES_PACKED, GET_CLIENT_COOKIES_PACKED_SHA },
+                    { REGISTER_COOKIES, REGISTER_COOKIES_SHA },
+                    { SET_COOKIE_DATA, SET_COOKIE_DATA_SHA },
+                };
+
+                for (const auto &[script, sha] : scripts) {
+                    auto reply = db->Command({ "SCRIPT", "LOAD", script }).get();
+                    if (!reply) {
+                        fprintf(stderr, "Invalid reply when loading lua script\n");
+                        return;
+                    }
+
+                    if (!reply->IsString()) {
+                        fprintf(stderr, "Load lua script error: %s\n", reply->Status());
+                        return;
+                    }
+
+                    if (reply->GetString() != sha) {
+                        fprintf(stderr, "Lua script sha dose not match: except:%s actual:%s\n",
+                            sha, reply->GetString().c_str());
+                        return;
+                    }
                 }
+            };
 
-                if (!reply->IsString()) {
-                    fprintf(stderr, "Load lua script error: %s\n", reply->Status());
+            async_redis::connection *replica = nullptr;
+            time_t replicaRetry = 0;
+            auto connectReplica = [&]() {
+                delete replica;
+                replica = nullptr;
+
+                // Do not hold up the queue on a replica that is down, the primary takes over meanwhile
+                if (time(NULL) < replicaRetry) {
                     return;
                 }
+                replicaRetry = time(NULL) + 10;
 
-                if (reply->GetString() != GET_CLIENT_COOKIES_SHA) {
-                    fprintf(stderr, "Lua script sha dose not match: except:%s actual:%s\n",
-                        GET_CLIENT_COOKIES_SHA, reply->GetString().c_str());
+                const auto &[replicaHost, replicaPort] = replicas[i % replicas.size()];
+                auto conn = new async_redis::client();
+                if (!conn->Connect(replicaHost, replicaPort, maxTimeout)) {
+                    delete conn;
                     return;
                 }
+
+                if (!pass.empty()) {
+                    auto reply = conn->Command({ "AUTH", pass }).get();
+                    if (!reply || !reply->IsStatus()) {
+                        fprintf(stderr, "REDIS ERROR: %s\n", reply ? reply->Status() : "no reply");
+                        delete conn;
+                        return;
+                    }
+                }
+
+                conn->Append({ "SELECT", std::to_string(dbid) });
+                conn->Append({ "SCRIPT", "LOAD", packedLoad ? GET_CLIENT_COOKIES_PACKED : GET_CLIENT_COOKIES }).Commit();
+                replica = conn;
             };
 
             connectDb();
@@ -163,19 +328,30 @@ bool ClientPrefs::SDK_OnLoad(char *error, size_t maxlength, bool late)
                     break;
                 }
 
+                op->OnDequeued();
+
                 if (db == nullptr || !db->IsConnected()) {
                     delete db;
                     db = nullptr;
                     connectDb();
+                    reconnected = true;
+                }
+
+                if (!replicas.empty() && (replica == nullptr || !replica->IsConnected())) {
+                    connectReplica();
                 }
 
                 db->Commit();
 
                 op->SetDatabase(db);
+                op->SetReplica(replica);
                 op->RunThreadPart();
                 tqq->PutResult(op);
             }
 
+            delete replica;
+            replica = nullptr;
+
             delete db;
             db = nullptr;
         }).detach();
@@ -183,6 +359,7 @@ bool ClientPrefs::SDK_OnLoad(char *error, size_t maxlength, bool late)
     // dbi->AddDependency(myself, Driver);
 
     sharesys->AddNatives(myself, g_ClientPrefNatives);
+    rootconsole->AddRootConsoleCommand3("cookies", "Client preferences (Redis)", this);
     sharesys->RegisterLibrary(myself, "clientprefs");
     identity = sharesys->CreateIdentity(sharesys->CreateIdentType("ClientPrefs"), this);
     g_CookieManager.cookieDataLoadedForward = forwards->CreateForward("OnClientCookiesCached", ET_Ignore, 1, NULL, Param_Cell);
@@ -203,6 +380,14 @@ bool ClientPrefs::SDK_OnLoad(char *error, size_t maxlength, bool late)
         myself->GetIdentity(),
         NULL);
 
+    g_CookieBatchType = handlesys->CreateType("CookieBatch",
+        &g_CookieBatchHandler,
+        0,
+        NULL,
+        NULL,
+        myself->GetIdentity(),
+        NULL);
+
     IMenuStyle *style = menus->GetDefaultStyle();
     g_CookieManager.clientMenu = style->CreateMenu(&g_Handler, identity);
     g_CookieManager.clientMenu->SetDefaultTitle("Client Settings:");
@@ -229,6 +414,7 @@ void ClientPrefs::SDK_OnAllLoaded()
 void ClientPrefs::SDK_OnUnload()
 {
     g_pSM->RemoveGameFrameHook(FrameHook);
+    rootconsole->RemoveRootConsoleCommand("cookies", this);
 
     for (int i = 0; i < worker; ++i) {
         tqq->AddToThreadQueue(nullptr, 0);
@@ -239,6 +425,9 @@ void ClientPrefs::SDK_OnUnload()
     }
 
     delete tqq;
+
+    subscriber.Stop();
+    warmCache.Close();
 }
 
 bool ClientPrefs::QueryInterfaceDrop(SMInterface *pInterface)
@@ -265,6 +454,7 @@ void ClientPrefs::SDK_OnDependenciesDropped()
 
     handlesys->RemoveType(g_CookieType, myself->GetIdentity());
     handlesys->RemoveType(g_CookieIterator, myself->GetIdentity());
+    handlesys->RemoveType(g_CookieBatchType, myself->GetIdentity());
 
     // Database = NULL;
 
@@ -285,8 +475,11 @@ void ClientPrefs::SDK_OnDependenciesDropped()
         }
 
         g_CookieManager.clientMenu = NULL;
+        g_CookieManager.menuData.clear();
     }
 
+    g_MenuCache.Clear();
+
     if (phrases != NULL) {
         phrases->Destroy();
         phrases = NULL;
@@ -298,11 +491,21 @@ void ClientPrefs::SDK_OnDependenciesDropped()
 
 void ClientPrefs::OnCoreMapStart(edict_t *pEdictList, int edictCount, int clientMax)
 {
+    if (tracking) {
+        smutils->LogMessage(myself, "Value cache: %llu hit(s), %llu miss(es), %llu invalidation(s), %llu key read(s) saved.",
+            (unsigned long long)valueCache.hits, (unsigned long long)valueCache.misses,
+            (unsigned long long)valueCache.invalidations, (unsigned long long)valueCache.keys_saved);
+    }
+
+    // Pick up translations reloaded since the menus were built
+    g_MenuCache.Clear();
+
     AttemptReconnection();
 }
 
 void ClientPrefs::AttemptReconnection()
 {
+    g_CookieManager.RetryUnboundCookies();
     CatchLateLoadClients(); /* DB reconnection, we should check if we missed anyone... */
 }
 
@@ -312,12 +515,30 @@ void ClientPrefs::DatabaseConnect()
 
 bool ClientPrefs::AddQueryToQueue(TQueryOp *query, int prio)
 {
+    query->Stamp(Stamp_Enqueue);
     tqq->AddToThreadQueue(query, prio);
     return true;
 }
 
 void ClientPrefs::RunFrame()
 {
+    g_CookieManager.RegisterPendingCookies();
+
+    if (reconnected.exchange(false)) {
+        AttemptReconnection();
+    }
+
+    // Writes published while the subscriber was away were missed
+    if (resubscribed.exchange(false)) {
+        warmCache.Unverify();
+        g_CookieManager.ResyncClients();
+    }
+
+    std::string message;
+    while (invalidations.try_dequeue(message)) {
+        g_CookieManager.ApplyInvalidation(message);
+    }
+
     auto op = tqq->GetResult();
     if (op == nullptr) {
         return;
@@ -327,6 +548,23 @@ void ClientPrefs::RunFrame()
     op->Destroy();
 }
 
+void ClientPrefs::OnRootConsoleCommand(const char *cmdname, const ICommandArgs *command)
+{
+    if (command->ArgC() >= 3 && strcmp(command->Arg(2), "stats") == 0) {
+        if (command->ArgC() >= 4 && strcmp(command->Arg(3), "reset") == 0) {
+            ResetQueryStats();
+            rootconsole->ConsolePrint("[Clientprefs] Query stats reset.");
+            return;
+        }
+
+        PrintQueryStats();
+        return;
+    }
+
+    rootconsole->ConsolePrint("SourceMod Client Preferences (Redis) Menu:");
+    rootconsole->DrawGenericOption("stats", "Query latency per stage, \"stats reset\" to start over");
+}
+
 const char *GetPlayerCompatAuthId(IGamePlayer *pPlayer)
 {
     /* For legacy reasons, OnClientAuthorized gives the Steam2 id here if using Steam auth */
@@ -445,6 +683,13 @@ ClientPrefs::ClientPrefs()
 {
     // Driver = NULL;
     databaseLoading = false;
+    invalidation = false;
+    tracking = false;
+    cluster = false;
+    packedLoad = true;
+    reconnected = false;
+    resubscribed = false;
+    maxValueLength = MAX_VALUE_LENGTH;
     phrases = NULL;
     // DBInfo = NULL;
 
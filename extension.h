@@ -45,7 +45,12 @@ extern "C" {
 
 #include "TQueue.h"
 #include "client.h"
+#include "cluster.h"
 #include "reply.h"
+#include "warmcache.h"
+#include "subscriber.h"
+#include "valuecache.h"
+#include "authidcache.h"
 
 #include <stdlib.h>
 #include <stdarg.h>
@@ -75,7 +80,7 @@ class TQueryOp;
  * @brief Sample implementation of the SDK Extension.
  * Note: Uncomment one of the pre-defined virtual functions in order to use it.
  */
-class ClientPrefs : public SDKExtension
+class ClientPrefs : public SDKExtension, public IRootConsoleCommand
 {
 public:
     ClientPrefs();
@@ -123,6 +128,9 @@ public:
 
     void RunFrame();
 
+    // "sm cookies stats [reset]"
+    void OnRootConsoleCommand(const char *cmdname, const ICommandArgs *command);
+
     /**
      * @brief Called when the pause state is changed.
      */
@@ -178,9 +186,37 @@ public:
     int port;
     int maxTimeout;
     int dbid;
+    bool cluster;
+
+    // Load players with the packed variant of the load script
+    bool packedLoad;
+
+    // Default maximum length of cookie values, cookies can raise their own
+    size_t maxValueLength;
+
+    // Read only endpoints players are loaded from
+    std::vector<std::pair<std::string, int>> replicas;
 
     IPhraseCollection *phrases;
 
+    WarmCache warmCache;
+
+    bool invalidation;
+    std::string invalidationChannel;
+    std::string invalidationOrigin;
+
+    bool tracking;
+    ValueCache valueCache;
+
+    // Recent reads of players who are not connected
+    AuthIdCache authIdCache;
+
+    // Values can only be served from memory while we are told about changes
+    bool UseValueCache() const
+    {
+        return tracking && subscriber.IsConnected();
+    }
+
     bool databaseLoading;
 
 private:
@@ -191,6 +227,14 @@ private:
     std::mutex connectLock;
 
     int worker;
+
+    // Set by a query thread which had to connect again, loads may have failed meanwhile
+    std::atomic<bool> reconnected;
+    // Set by the subscriber once it is back, invalidations were lost meanwhile
+    std::atomic<bool> resubscribed;
+
+    async_redis::subscriber subscriber;
+    moodycamel::ConcurrentQueue<std::string> invalidations;
 };
 
 class CookieTypeHandler : public IHandleTypeDispatch
@@ -211,7 +255,14 @@ public:
     }
 };
 
+class CookieBatchHandler : public IHandleTypeDispatch
+{
+public:
+    void OnHandleDestroy(HandleType_t type, void *object);
+};
+
 const char *GetPlayerCompatAuthId(IGamePlayer *pPlayer);
+size_t IsAuthIdConnected(const char *authID);
 
 extern sp_nativeinfo_t g_ClientPrefNatives[];
 
@@ -222,6 +273,9 @@ extern CookieTypeHandler g_CookieTypeHandler;
 extern HandleType_t g_CookieIterator;
 extern CookieIteratorHandler g_CookieIteratorHandler;
 
+extern HandleType_t g_CookieBatchType;
+extern CookieBatchHandler g_CookieBatchHandler;
+
 bool Translate(char *buffer,
     size_t maxlength,
     const char *format,
@@ -33,14 +33,11 @@
 
 ClientMenuHandler g_Handler;
 AutoMenuHandler g_AutoHandler;
+MenuCache g_MenuCache;
 
 void ClientMenuHandler::OnMenuSelect(IBaseMenu *menu, int client, unsigned int item)
 {
-	ItemDrawInfo draw;
-
-	const char *info = menu->GetItemInfo(item, &draw);
-
-	AutoMenuData *data = (AutoMenuData *)strtoul(info, NULL, 16);
+	AutoMenuData *data = g_CookieManager.GetMenuData(item);
 
 	if (data->handler->forward != NULL)
 	{
@@ -57,31 +54,8 @@ void ClientMenuHandler::OnMenuSelect(IBaseMenu *menu, int client, unsigned int i
 		return;
 	}
 
-	IBaseMenu *submenu = menus->GetDefaultStyle()->CreateMenu(&g_AutoHandler, g_ClientPrefs.GetIdentity());
-
-	char message[256];
-
-	Translate(message, sizeof(message), "%T:", 2, NULL, "Choose Option", &client);
-	submenu->SetDefaultTitle(message);
-
-	if (data->type == CookieMenu_YesNo || data->type == CookieMenu_YesNo_Int)
-	{
-		Translate(message, sizeof(message), "%T", 2, NULL, "Yes", &client);
-		submenu->AppendItem(info, message);
-
-		Translate(message, sizeof(message), "%T", 2, NULL, "No", &client);
-		submenu->AppendItem(info, message);
-	}
-	else if (data->type == CookieMenu_OnOff || data->type == CookieMenu_OnOff_Int)
-	{
-		Translate(message, sizeof(message), "%T", 2, NULL, "On", &client);
-		submenu->AppendItem(info, message);
-
-		Translate(message, sizeof(message), "%T", 2, NULL, "Off", &client);
-		submenu->AppendItem(info, message);
-	}
-
-	submenu->Display(client, 0, NULL);
+	g_AutoHandler.selection[client] = data;
+	g_MenuCache.AutoMenu(client, data->type)->Display(client, 0, NULL);
 }
 
 unsigned int ClientMenuHandler::OnMenuDisplayItem(IBaseMenu *menu, 
@@ -90,16 +64,12 @@ unsigned int ClientMenuHandler::OnMenuDisplayItem(IBaseMenu *menu,
 										   unsigned int item, 
 										   const ItemDrawInfo &dr)
 {
-	ItemDrawInfo draw;
-
-	const char *info = menu->GetItemInfo(item, &draw);
-
-	AutoMenuData *data = (AutoMenuData *)strtoul(info, NULL, 16);
+	AutoMenuData *data = g_CookieManager.GetMenuData(item);
 
 	if (data->handler->forward != NULL)
 	{
 		char buffer[100];
-		g_pSM->Format(buffer, sizeof(buffer), "%s", dr.display);
+		UTIL_strncpy(buffer, dr.display, sizeof(buffer));
 
 		data->handler->forward->PushCell(client);
 		data->handler->forward->PushCell(CookieMenuAction_DisplayOption);
@@ -108,7 +78,7 @@ unsigned int ClientMenuHandler::OnMenuDisplayItem(IBaseMenu *menu,
 		data->handler->forward->PushCell(sizeof(buffer));
 		data->handler->forward->Execute(NULL);
 
-		ItemDrawInfo newdraw(buffer, draw.style);
+		ItemDrawInfo newdraw(buffer, dr.style);
 
 		return panel->DrawItem(newdraw);
 	}
@@ -119,11 +89,12 @@ unsigned int ClientMenuHandler::OnMenuDisplayItem(IBaseMenu *menu,
 void AutoMenuHandler::OnMenuSelect(SourceMod::IBaseMenu *menu, int client, unsigned int item)
 {
 	static const char settings[CookieMenu_Elements][2][4] = { {"yes", "no"}, {"1", "0"}, {"on", "off"}, {"1", "0"} };
-	ItemDrawInfo draw;
-
-	const char *info = menu->GetItemInfo(item, &draw);
 
-	AutoMenuData *data = (AutoMenuData *)strtoul(info, NULL, 16);
+	AutoMenuData *data = selection[client];
+	if (data == NULL)
+	{
+		return;
+	}
 
 	g_CookieManager.SetCookieValue(data->pCookie, client, settings[data->type][item]);
 	
@@ -135,12 +106,76 @@ void AutoMenuHandler::OnMenuSelect(SourceMod::IBaseMenu *menu, int client, unsig
 	gamehelpers->TextMsg(client, 3, message);
 }
 
-void AutoMenuHandler::OnMenuEnd(IBaseMenu *menu, MenuEndReason reason)
+MenuCache::Language &MenuCache::Find(int client)
+{
+	unsigned int language = translator->GetClientLanguage(client);
+
+	auto iter = languages.find(language);
+	if (iter != languages.end())
+	{
+		return iter->second;
+	}
+
+	/* Every client of a language gets the same translation, this one stands in for all of them */
+	Language &entry = languages[language];
+	Translate(entry.title, sizeof(entry.title), "%T:", 2, NULL, "Client Settings", &client);
+	entry.autoMenus[0] = NULL;
+	entry.autoMenus[1] = NULL;
+
+	return entry;
+}
+
+const char *MenuCache::SettingsTitle(int client)
+{
+	return Find(client).title;
+}
+
+IBaseMenu *MenuCache::AutoMenu(int client, CookieMenu type)
+{
+	bool onOff = (type == CookieMenu_OnOff || type == CookieMenu_OnOff_Int);
+
+	IBaseMenu *&submenu = Find(client).autoMenus[onOff];
+	if (submenu != NULL)
+	{
+		return submenu;
+	}
+
+	submenu = menus->GetDefaultStyle()->CreateMenu(&g_AutoHandler, g_ClientPrefs.GetIdentity());
+
+	char message[256];
+
+	Translate(message, sizeof(message), "%T:", 2, NULL, "Choose Option", &client);
+	submenu->SetDefaultTitle(message);
+
+	Translate(message, sizeof(message), "%T", 2, NULL, onOff ? "On" : "Yes", &client);
+	submenu->AppendItem("", message);
+
+	Translate(message, sizeof(message), "%T", 2, NULL, onOff ? "Off" : "No", &client);
+	submenu->AppendItem("", message);
+
+	return submenu;
+}
+
+void MenuCache::Clear()
 {
 	HandleSecurity sec = HandleSecurity(g_ClientPrefs.GetIdentity(), g_ClientPrefs.GetIdentity());
-	HandleError err = handlesys->FreeHandle(menu->GetHandle(), &sec);
-	if (HandleError_None != err)
+
+	for (auto &[language, entry] : languages)
 	{
-		g_pSM->LogError(myself, "Error %d when attempting to free automenu handle", err);
+		for (IBaseMenu *submenu : entry.autoMenus)
+		{
+			if (submenu == NULL)
+			{
+				continue;
+			}
+
+			HandleError err = handlesys->FreeHandle(submenu->GetHandle(), &sec);
+			if (HandleError_None != err)
+			{
+				g_pSM->LogError(myself, "Error %d when attempting to free automenu handle", err);
+			}
+		}
 	}
+
+	languages.clear();
 }
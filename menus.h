@@ -35,6 +35,8 @@
 #include "extension.h"
 #include "cookie.h"
 
+#include <unordered_map>
+
 enum CookieMenuAction
 {
 	/**
@@ -79,14 +81,42 @@ class ClientMenuHandler : public IMenuHandler
 										   const ItemDrawInfo &dr);
 };
 
+struct AutoMenuData;
+
 class AutoMenuHandler : public IMenuHandler
 {
 	void OnMenuSelect(IBaseMenu *menu, int client, unsigned int item);
-	void OnMenuEnd(IBaseMenu *menu, MenuEndReason reason);
+
+public:
+	/* The settings item each client opened the shared auto menu from */
+	AutoMenuData *selection[SM_MAXPLAYERS+1];
+};
+
+/* Translated phrases and auto menus of every language, built the first time a client using it needs them */
+class MenuCache
+{
+public:
+	const char *SettingsTitle(int client);
+	/* The Yes/No or On/Off menu, shared by every cookie of that type */
+	IBaseMenu *AutoMenu(int client, CookieMenu type);
+	/* Translations may have been reloaded */
+	void Clear();
+
+private:
+	struct Language
+	{
+		char title[256];
+		IBaseMenu *autoMenus[2];
+	};
+
+	Language &Find(int client);
+
+	std::unordered_map<unsigned int, Language> languages;
 };
 
 extern ClientMenuHandler g_Handler;
 extern AutoMenuHandler g_AutoHandler;
+extern MenuCache g_MenuCache;
 
 /* Something went wrong with the includes and made me do this */
 struct Cookie;
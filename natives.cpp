@@ -35,8 +35,6 @@
 
 cell_t RegClientPrefCookie(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	char *name;
 	pContext->LocalToString(params[1], &name);
 
@@ -64,8 +62,6 @@ cell_t RegClientPrefCookie(IPluginContext *pContext, const cell_t *params)
 
 cell_t FindClientPrefCookie(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	char *name;
 	pContext->LocalToString(params[1], &name);
 
@@ -83,35 +79,13 @@ cell_t FindClientPrefCookie(IPluginContext *pContext, const cell_t *params)
 		NULL);
 }
 
-size_t IsAuthIdConnected(char *authID)
+size_t IsAuthIdConnected(const char *authID)
 {
-	IGamePlayer *player;
-	const char *authString;
-	
-	for (int playerIndex = playerhelpers->GetMaxClients()+1; --playerIndex > 0;)
-	{
-		player = playerhelpers->GetGamePlayer(playerIndex);
-		if (player == NULL || !player->IsAuthorized())
-		{
-			continue;
-		}
-		
-		if (!strcmp(player->GetAuthString(), authID)
-			|| !strcmp(player->GetSteam2Id(), authID)
-			|| !strcmp(player->GetSteam3Id(), authID)
-			)
-		{
-			return playerIndex;
-		}
-	}
-
-	return 0;
+	return g_CookieManager.FindClientByAuthId(authID);
 }
 
 cell_t SetAuthIdCookie(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	char *steamID;
 	pContext->LocalToString(params[1], &steamID);
 
@@ -131,7 +105,6 @@ cell_t SetAuthIdCookie(IPluginContext *pContext, const cell_t *params)
 		return pContext->ThrowNativeError("Invalid Cookie handle %x (error %d)", hndl, err);
 	}
 
-	int i_dbId = pCookie->dbid;
 	char *value;
 	pContext->LocalToString(params[3], &value);
 
@@ -142,29 +115,23 @@ cell_t SetAuthIdCookie(IPluginContext *pContext, const cell_t *params)
 		return g_CookieManager.SetCookieValue(pCookie, client, value);
 	}
 
-	// constructor calls strncpy for us
-	CookieData *payload = new CookieData(value);
-
-	// set changed so players connecting later in during the same map will have the correct value
-	payload->changed = true;
-	payload->timestamp = time(NULL);
+	// the cached copies of this player are outdated now
+	g_ClientPrefs.warmCache.Evict(steamID);
+	g_ClientPrefs.authIdCache.Evict(steamID);
 
 	// edit database table
 	TQueryOp *op = new TQueryOp(Query_InsertData, pCookie);
 	// limit player auth length which doubles for cookie name length
 	UTIL_strncpy(op->m_params.steamId, steamID, MAX_NAME_LENGTH);
-	op->m_params.cookieId = i_dbId;
-	op->m_params.data = payload;
+	op->m_params.value.assign(value, strnlen(value, pCookie->maxLength));
 
-	g_ClientPrefs.AddQueryToQueue(op);
+	g_CookieManager.QueueInsertData(pCookie, op);
 
 	return 1;
 }
 
 cell_t SetClientPrefCookie(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	int client = params[1];
 
 	if ((client < 1) || (client > playerhelpers->GetMaxClients()))
@@ -195,8 +162,6 @@ cell_t SetClientPrefCookie(IPluginContext *pContext, const cell_t *params)
 
 cell_t GetClientPrefCookie(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	int client = params[1];
 
 	if ((client < 1) || (client > playerhelpers->GetMaxClients()))
@@ -230,8 +195,6 @@ cell_t GetClientPrefCookie(IPluginContext *pContext, const cell_t *params)
 
 cell_t AreClientCookiesCached(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	int client = params[1];
 
 	if ((client < 1) || (client > playerhelpers->GetMaxClients()))
@@ -244,8 +207,6 @@ cell_t AreClientCookiesCached(IPluginContext *pContext, const cell_t *params)
 
 cell_t GetCookieAccess(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	Handle_t hndl = static_cast<Handle_t>(params[1]);
 	HandleError err;
 	HandleSecurity sec;
@@ -264,10 +225,36 @@ cell_t GetCookieAccess(IPluginContext *pContext, const cell_t *params)
 	return pCookie->access;
 }
 
-static cell_t GetCookieIterator(IPluginContext *pContext, const cell_t *params)
+cell_t SetCookieMaxLength(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
+	Handle_t hndl = static_cast<Handle_t>(params[1]);
+	HandleError err;
+	HandleSecurity sec;
 
+	sec.pOwner = NULL;
+	sec.pIdentity = myself->GetIdentity();
+
+	Cookie *pCookie;
+
+	if ((err = handlesys->ReadHandle(hndl, g_CookieType, &sec, (void **)&pCookie))
+	     != HandleError_None)
+	{
+		return pContext->ThrowNativeError("Invalid Cookie handle %x (error %d)", hndl, err);
+	}
+
+	if (params[2] < 1)
+	{
+		return pContext->ThrowNativeError("Invalid maximum length %d", params[2]);
+	}
+
+	// values stored before are not truncated again
+	pCookie->maxLength = params[2];
+
+	return 1;
+}
+
+static cell_t GetCookieIterator(IPluginContext *pContext, const cell_t *params)
+{
 	size_t *iter = new size_t;
 	*iter = 0;
 
@@ -282,8 +269,6 @@ static cell_t GetCookieIterator(IPluginContext *pContext, const cell_t *params)
 
 static cell_t ReadCookieIterator(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	size_t *iter;
 
 	Handle_t hndl = static_cast<Handle_t>(params[1]);
@@ -318,12 +303,7 @@ static cell_t ReadCookieIterator(IPluginContext *pContext, const cell_t *params)
 
 cell_t ShowSettingsMenu(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
-	char message[256];
-	Translate(message, sizeof(message), "%T:", 2, NULL, "Client Settings", &params[1]);
-
-	g_CookieManager.clientMenu->SetDefaultTitle(message);
+	g_CookieManager.clientMenu->SetDefaultTitle(g_MenuCache.SettingsTitle(params[1]));
 	g_CookieManager.clientMenu->Display(params[1], 0, NULL);
 
 	return 0;
@@ -331,8 +311,6 @@ cell_t ShowSettingsMenu(IPluginContext *pContext, const cell_t *params)
 
 cell_t AddSettingsMenuItem(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	char *display;
 	pContext->LocalToString(params[3], &display);
 
@@ -343,15 +321,13 @@ cell_t AddSettingsMenuItem(IPluginContext *pContext, const cell_t *params)
 
 	pItem->forward->AddFunction(pContext, static_cast<funcid_t>(params[1]));
 
-	char info[20];
 	AutoMenuData *data = new AutoMenuData;
 	data->datavalue = params[2];
 	data->handler = pItem;
-	g_pSM->Format(info, sizeof(info), "%x", data);
 
 	ItemDrawInfo draw(display, 0);
 
-	g_CookieManager.clientMenu->AppendItem(info, draw);
+	g_CookieManager.AppendMenuItem(data, draw);
 
 	/* Track this in case the plugin unloads */
 
@@ -374,8 +350,6 @@ cell_t AddSettingsMenuItem(IPluginContext *pContext, const cell_t *params)
 
 cell_t AddSettingsPrefabMenuItem(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	Handle_t hndl = static_cast<Handle_t>(params[1]);
 	HandleError err;
 	HandleSecurity sec;
@@ -413,15 +387,13 @@ cell_t AddSettingsPrefabMenuItem(IPluginContext *pContext, const cell_t *params)
 
 	ItemDrawInfo draw(display, 0);
 
-	char info[20];
 	AutoMenuData *data = new AutoMenuData;
 	data->datavalue = params[5];
 	data->pCookie = pCookie;
 	data->type = (CookieMenu)params[2];
 	data->handler = pItem;
-	g_pSM->Format(info, sizeof(info), "%x", data);
 
-	g_CookieManager.clientMenu->AppendItem(info, draw);
+	g_CookieManager.AppendMenuItem(data, draw);
 
 	/* Track this in case the plugin unloads */
 
@@ -444,8 +416,6 @@ cell_t AddSettingsPrefabMenuItem(IPluginContext *pContext, const cell_t *params)
 
 cell_t GetClientCookieTime(IPluginContext *pContext, const cell_t *params)
 {
-	g_ClientPrefs.AttemptReconnection();
-
 	Handle_t hndl = static_cast<Handle_t>(params[2]);
 	HandleError err;
 	HandleSecurity sec;
@@ -471,6 +441,519 @@ cell_t GetClientCookieTime(IPluginContext *pContext, const cell_t *params)
 	return value;
 }
 
+static Cookie *ReadCookieHandle(IPluginContext *pContext, cell_t param)
+{
+	Handle_t hndl = static_cast<Handle_t>(param);
+	HandleError err;
+	HandleSecurity sec;
+
+	sec.pOwner = NULL;
+	sec.pIdentity = myself->GetIdentity();
+
+	Cookie *pCookie;
+
+	if ((err = handlesys->ReadHandle(hndl, g_CookieType, &sec, (void **)&pCookie))
+		!= HandleError_None)
+	{
+		pContext->ThrowNativeError("Invalid Cookie handle %x (error %d)", hndl, err);
+		return NULL;
+	}
+
+	return pCookie;
+}
+
+/* Value of a typed read, NULL for clients without a value */
+static CookieData *ReadTypedValue(IPluginContext *pContext, const cell_t *params, bool *error)
+{
+	int client = params[1];
+
+	if ((client < 1) || (client > playerhelpers->GetMaxClients()))
+	{
+		pContext->ThrowNativeError("Client index %d is invalid", client);
+		*error = true;
+		return NULL;
+	}
+
+	Cookie *pCookie = ReadCookieHandle(pContext, params[2]);
+	if (pCookie == NULL)
+	{
+		*error = true;
+		return NULL;
+	}
+
+	*error = false;
+
+	CookieData *data = g_CookieManager.GetCookieData(pCookie, client);
+	if (data == NULL || data->value.empty())
+	{
+		return NULL;
+	}
+
+	return data;
+}
+
+cell_t GetClientCookieInt(IPluginContext *pContext, const cell_t *params)
+{
+	bool error;
+	CookieData *data = ReadTypedValue(pContext, params, &error);
+
+	if (data == NULL)
+	{
+		return error ? 0 : params[3];
+	}
+
+	return data->AsInt();
+}
+
+cell_t GetClientCookieFloat(IPluginContext *pContext, const cell_t *params)
+{
+	bool error;
+	CookieData *data = ReadTypedValue(pContext, params, &error);
+
+	if (data == NULL)
+	{
+		return error ? 0 : params[3];
+	}
+
+	return sp_ftoc(data->AsFloat());
+}
+
+cell_t GetClientCookieBool(IPluginContext *pContext, const cell_t *params)
+{
+	bool error;
+	CookieData *data = ReadTypedValue(pContext, params, &error);
+
+	if (data == NULL)
+	{
+		return error ? 0 : params[3];
+	}
+
+	return data->AsBool();
+}
+
+/* Stores a typed write, formatted the way plugins would have done it */
+static cell_t WriteTypedValue(IPluginContext *pContext, const cell_t *params, const char *value)
+{
+	int client = params[1];
+
+	if ((client < 1) || (client > playerhelpers->GetMaxClients()))
+	{
+		return pContext->ThrowNativeError("Client index %d is invalid", client);
+	}
+
+	Cookie *pCookie = ReadCookieHandle(pContext, params[2]);
+	if (pCookie == NULL)
+	{
+		return 0;
+	}
+
+	return g_CookieManager.SetCookieValue(pCookie, client, value);
+}
+
+cell_t SetClientCookieInt(IPluginContext *pContext, const cell_t *params)
+{
+	char value[16];
+	g_pSM->Format(value, sizeof(value), "%d", params[3]);
+
+	return WriteTypedValue(pContext, params, value);
+}
+
+cell_t SetClientCookieFloat(IPluginContext *pContext, const cell_t *params)
+{
+	char value[64];
+	g_pSM->Format(value, sizeof(value), "%f", sp_ctof(params[3]));
+
+	return WriteTypedValue(pContext, params, value);
+}
+
+cell_t SetClientCookieBool(IPluginContext *pContext, const cell_t *params)
+{
+	return WriteTypedValue(pContext, params, params[3] ? "1" : "0");
+}
+
+cell_t GetClientCookies(IPluginContext *pContext, const cell_t *params)
+{
+	int client = params[1];
+
+	if ((client < 1) || (client > playerhelpers->GetMaxClients()))
+	{
+		return pContext->ThrowNativeError("Client index %d is invalid", client);
+	}
+
+	cell_t *cookies, *offsets;
+	char *buffer;
+	pContext->LocalToPhysAddr(params[2], &cookies);
+	pContext->LocalToString(params[4], &buffer);
+	pContext->LocalToPhysAddr(params[6], &offsets);
+
+	size_t maxlength = params[5] > 0 ? params[5] : 0;
+	size_t pos = 0;
+
+	// every value is written null terminated, back to back
+	for (cell_t i = 0; i < params[3]; i++)
+	{
+		Cookie *pCookie = ReadCookieHandle(pContext, cookies[i]);
+		if (pCookie == NULL)
+		{
+			return 0;
+		}
+
+		CookieData *data = g_CookieManager.GetCookieData(pCookie, client);
+		size_t length = data ? data->value.size() : 0;
+
+		if (pos + length + 1 > maxlength)
+		{
+			return i;
+		}
+
+		if (length)
+		{
+			memcpy(&buffer[pos], data->value.c_str(), length);
+		}
+		buffer[pos + length] = '\0';
+
+		offsets[i] = pos;
+		pos += length + 1;
+	}
+
+	return params[3];
+}
+
+cell_t SetClientCookies(IPluginContext *pContext, const cell_t *params)
+{
+	int client = params[1];
+
+	if ((client < 1) || (client > playerhelpers->GetMaxClients()))
+	{
+		return pContext->ThrowNativeError("Client index %d is invalid", client);
+	}
+
+	cell_t *cookies;
+	char *values;
+	pContext->LocalToPhysAddr(params[2], &cookies);
+	pContext->LocalToString(params[4], &values);
+
+	size_t size = params[5] > 0 ? params[5] : 0;
+	size_t pos = 0;
+
+	for (cell_t i = 0; i < params[3]; i++)
+	{
+		Cookie *pCookie = ReadCookieHandle(pContext, cookies[i]);
+		if (pCookie == NULL)
+		{
+			return 0;
+		}
+
+		const char *end = pos < size ? (const char *)memchr(&values[pos], '\0', size - pos) : NULL;
+		if (end == NULL)
+		{
+			return pContext->ThrowNativeError("Only %d of %d values found in the buffer", i, params[3]);
+		}
+
+		g_CookieManager.SetCookieValue(pCookie, client, &values[pos]);
+		pos = end - values + 1;
+	}
+
+	return 1;
+}
+
+cell_t GetClientCookiesPacked(IPluginContext *pContext, const cell_t *params)
+{
+	int client = params[1];
+
+	if ((client < 1) || (client > playerhelpers->GetMaxClients()))
+	{
+		return pContext->ThrowNativeError("Client index %d is invalid", client);
+	}
+
+	char *buffer;
+	pContext->LocalToString(params[2], &buffer);
+
+	size_t maxlength = params[3] > 0 ? params[3] : 0;
+	size_t pos = 0;
+
+	// name and value of every cookie with a value, null terminated, back to back
+	g_CookieManager.ForEachCookieData(client, [&](Cookie *pCookie, CookieData &data) {
+		if (data.value.empty())
+		{
+			return;
+		}
+
+		size_t name = strlen(pCookie->name) + 1;
+		size_t value = data.value.size() + 1;
+
+		if (pos + name + value <= maxlength)
+		{
+			memcpy(&buffer[pos], pCookie->name, name);
+			memcpy(&buffer[pos + name], data.value.c_str(), value);
+		}
+		pos += name + value;
+	});
+
+	// the size needed, the caller retries with a larger buffer if it did not fit
+	return pos;
+}
+
+/* Arrays indexed by client have to hold an entry for every client slot */
+static bool CheckClientArraySize(IPluginContext *pContext, cell_t size)
+{
+	int needed = playerhelpers->GetMaxClients() + 1;
+	if (size < needed)
+	{
+		pContext->ThrowNativeError("Array size %d is smaller than MaxClients + 1 (%d)", size, needed);
+		return false;
+	}
+
+	return true;
+}
+
+cell_t GetAllClientsCookie(IPluginContext *pContext, const cell_t *params)
+{
+	Cookie *pCookie = ReadCookieHandle(pContext, params[1]);
+	if (pCookie == NULL)
+	{
+		return 0;
+	}
+
+	if (!CheckClientArraySize(pContext, params[5]))
+	{
+		return 0;
+	}
+
+	char *buffer;
+	cell_t *offsets;
+	pContext->LocalToString(params[2], &buffer);
+	pContext->LocalToPhysAddr(params[4], &offsets);
+
+	for (cell_t client = 0; client < params[5]; client++)
+	{
+		offsets[client] = -1;
+	}
+
+	size_t maxlength = params[3] > 0 ? params[3] : 0;
+	size_t pos = 0;
+
+	// one value per client with loaded cookies, null terminated, back to back
+	g_CookieManager.ForEachClientData(pCookie, [&](int client, CookieData *data) {
+		size_t length = data ? data->value.size() : 0;
+
+		if (pos + length + 1 <= maxlength)
+		{
+			if (length)
+			{
+				memcpy(&buffer[pos], data->value.c_str(), length);
+			}
+			buffer[pos + length] = '\0';
+			offsets[client] = pos;
+		}
+		pos += length + 1;
+	});
+
+	// the size needed, clients which did not fit are left at -1
+	return pos;
+}
+
+/* Fills values[client] for every client, returns how many have a value */
+template <typename F>
+static cell_t ReadTypedColumn(IPluginContext *pContext, const cell_t *params, F read)
+{
+	Cookie *pCookie = ReadCookieHandle(pContext, params[1]);
+	if (pCookie == NULL)
+	{
+		return 0;
+	}
+
+	if (!CheckClientArraySize(pContext, params[3]))
+	{
+		return 0;
+	}
+
+	cell_t *values;
+	pContext->LocalToPhysAddr(params[2], &values);
+
+	for (cell_t client = 0; client < params[3]; client++)
+	{
+		values[client] = params[4];
+	}
+
+	/* Read from the parsed column of the cookie, the values of the clients are not touched */
+	const CookieColumn &column = g_CookieManager.GetColumn(pCookie);
+
+	cell_t found = 0;
+	int maxClients = playerhelpers->GetMaxClients();
+	for (int client = 1; client <= maxClients; client++)
+	{
+		if (column.set[client] && g_CookieManager.AreClientCookiesCached(client))
+		{
+			values[client] = read(column, client);
+			found++;
+		}
+	}
+
+	return found;
+}
+
+cell_t GetAllClientsCookieInt(IPluginContext *pContext, const cell_t *params)
+{
+	return ReadTypedColumn(pContext, params, [](const CookieColumn &column, int client) -> cell_t {
+		return column.ints[client];
+	});
+}
+
+cell_t GetAllClientsCookieFloat(IPluginContext *pContext, const cell_t *params)
+{
+	return ReadTypedColumn(pContext, params, [](const CookieColumn &column, int client) -> cell_t {
+		return sp_ftoc(column.floats[client]);
+	});
+}
+
+cell_t CreateCookieBatch(IPluginContext *pContext, const cell_t *params)
+{
+	Cookie *pCookie = ReadCookieHandle(pContext, params[1]);
+	if (pCookie == NULL)
+	{
+		return BAD_HANDLE;
+	}
+
+	CookieBatch *batch = new CookieBatch;
+	batch->cookie = pCookie;
+
+	Handle_t hndl = handlesys->CreateHandle(g_CookieBatchType, batch, pContext->GetIdentity(), myself->GetIdentity(), NULL);
+	if (hndl == BAD_HANDLE)
+	{
+		delete batch;
+	}
+
+	return hndl;
+}
+
+static CookieBatch *ReadCookieBatch(IPluginContext *pContext, cell_t param)
+{
+	Handle_t hndl = static_cast<Handle_t>(param);
+	HandleError err;
+	HandleSecurity sec;
+
+	sec.pOwner = NULL;
+	sec.pIdentity = myself->GetIdentity();
+
+	CookieBatch *batch;
+
+	if ((err = handlesys->ReadHandle(hndl, g_CookieBatchType, &sec, (void **)&batch))
+		!= HandleError_None)
+	{
+		pContext->ThrowNativeError("Invalid Cookie batch handle %x (error %d)", hndl, err);
+		return NULL;
+	}
+
+	return batch;
+}
+
+cell_t AddCookieBatchValue(IPluginContext *pContext, const cell_t *params)
+{
+	CookieBatch *batch = ReadCookieBatch(pContext, params[1]);
+	if (batch == NULL)
+	{
+		return 0;
+	}
+
+	char *steamID, *value;
+	pContext->LocalToString(params[2], &steamID);
+	pContext->LocalToString(params[3], &value);
+
+	// same limits as SetAuthIdCookie
+	batch->values.emplace_back(std::string(steamID, strnlen(steamID, MAX_NAME_LENGTH - 1)),
+		std::string(value, strnlen(value, batch->cookie->maxLength)));
+
+	return batch->values.size();
+}
+
+cell_t SendCookieBatch(IPluginContext *pContext, const cell_t *params)
+{
+	CookieBatch *batch = ReadCookieBatch(pContext, params[1]);
+	if (batch == NULL)
+	{
+		return 0;
+	}
+
+	IChangeableForward *callback = forwards->CreateForwardEx(NULL, ET_Ignore, 3, NULL, Param_Cell, Param_Cell, Param_Cell);
+	callback->AddFunction(pContext, static_cast<funcid_t>(params[2]));
+
+	g_CookieManager.SendBatch(batch, callback, params[3]);
+
+	// the batch is consumed, like a sent transaction
+	HandleSecurity sec;
+	sec.pOwner = pContext->GetIdentity();
+	sec.pIdentity = myself->GetIdentity();
+	handlesys->FreeHandle(static_cast<Handle_t>(params[1]), &sec);
+
+	return 1;
+}
+
+cell_t GetAuthIdCookieAsync(IPluginContext *pContext, const cell_t *params)
+{
+	char *steamID;
+	pContext->LocalToString(params[1], &steamID);
+
+	Cookie *pCookie = ReadCookieHandle(pContext, params[2]);
+	if (pCookie == NULL)
+	{
+		return 0;
+	}
+
+	AuthIdRead *read = new AuthIdRead;
+	read->callback = forwards->CreateForwardEx(NULL, ET_Ignore, 5, NULL, Param_String, Param_Cell, Param_String, Param_Cell, Param_Cell);
+	read->callback->AddFunction(pContext, static_cast<funcid_t>(params[3]));
+	read->data = params[4];
+	read->multiple = false;
+	read->handle = params[2];
+	read->authid.assign(steamID, strnlen(steamID, MAX_NAME_LENGTH - 1));
+	read->cookies.push_back(pCookie);
+	read->success = false;
+
+	g_CookieManager.ReadAuthIdCookies(read);
+
+	return 1;
+}
+
+cell_t GetAuthIdCookiesAsync(IPluginContext *pContext, const cell_t *params)
+{
+	char *steamID;
+	pContext->LocalToString(params[1], &steamID);
+
+	if (params[3] < 1)
+	{
+		return pContext->ThrowNativeError("Invalid number of cookies %d", params[3]);
+	}
+
+	cell_t *cookies;
+	pContext->LocalToPhysAddr(params[2], &cookies);
+
+	std::vector<Cookie *> list;
+	for (cell_t i = 0; i < params[3]; i++)
+	{
+		Cookie *pCookie = ReadCookieHandle(pContext, cookies[i]);
+		if (pCookie == NULL)
+		{
+			return 0;
+		}
+		list.push_back(pCookie);
+	}
+
+	AuthIdRead *read = new AuthIdRead;
+	read->callback = forwards->CreateForwardEx(NULL, ET_Ignore, 6, NULL, Param_String, Param_String, Param_Array, Param_Cell, Param_Cell, Param_Cell);
+	read->callback->AddFunction(pContext, static_cast<funcid_t>(params[4]));
+	read->data = params[5];
+	read->multiple = true;
+	read->handle = BAD_HANDLE;
+	read->authid.assign(steamID, strnlen(steamID, MAX_NAME_LENGTH - 1));
+	read->cookies = std::move(list);
+	read->success = false;
+
+	g_CookieManager.ReadAuthIdCookies(read);
+
+	return 1;
+}
+
 sp_nativeinfo_t g_ClientPrefNatives[] = 
 {
 	{"RegClientCookie",				RegClientPrefCookie},
@@ -486,5 +969,23 @@ sp_nativeinfo_t g_ClientPrefNatives[] =
 	{"SetCookieMenuItem",			AddSettingsMenuItem},
 	{"SetCookiePrefabMenu",			AddSettingsPrefabMenuItem},
 	{"GetClientCookieTime",         GetClientCookieTime},
+	{"SetCookieMaxLength",			SetCookieMaxLength},
+	{"GetClientCookieInt",			GetClientCookieInt},
+	{"GetClientCookieFloat",		GetClientCookieFloat},
+	{"GetClientCookieBool",			GetClientCookieBool},
+	{"SetClientCookieInt",			SetClientCookieInt},
+	{"SetClientCookieFloat",		SetClientCookieFloat},
+	{"SetClientCookieBool",			SetClientCookieBool},
+	{"GetClientCookies",			GetClientCookies},
+	{"SetClientCookies",			SetClientCookies},
+	{"GetClientCookiesPacked",		GetClientCookiesPacked},
+	{"GetAllClientsCookie",			GetAllClientsCookie},
+	{"GetAllClientsCookieInt",		GetAllClientsCookieInt},
+	{"GetAllClientsCookieFloat",	GetAllClientsCookieFloat},
+	{"CreateCookieBatch",			CreateCookieBatch},
+	{"AddCookieBatchValue",			AddCookieBatchValue},
+	{"SendCookieBatch",				SendCookieBatch},
+	{"GetAuthIdCookieAsync",		GetAuthIdCookieAsync},
+	{"GetAuthIdCookiesAsync",		GetAuthIdCookiesAsync},
 	{NULL,							NULL}
 };
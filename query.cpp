@@ -31,27 +31,247 @@
 
 #include "query.h"
 
-#define CookieName  0
-#define CookieDesc  1
-#define CookieAcce  2
-#define CookieValue 3
-
-#include <functional>
 #include <string>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+
+std::string PlayerKey(const char *steamId)
+{
+    if (g_ClientPrefs.cluster) {
+        return std::string("{") + steamId + "}";
+    }
+    return steamId;
+}
+
+std::string ValueKey(const char *steamId, int cookieId)
+{
+    return PlayerKey(steamId) + "." + std::to_string(cookieId);
+}
+
+std::string VersionKey(const char *steamId)
+{
+    // One counter per player in both modes, in cluster mode it shares the slot of the values it versions
+    return PlayerKey(steamId) + ".version";
+}
+
+const char *MetadataKey()
+{
+    return g_ClientPrefs.cluster ? "{cookies}" : "cookies";
+}
+
+static std::atomic<bool> has_readonly(true);
+
+// Run a script by its sha, falling back to sending the whole script if the server lost it
+// Read only scripts use EVALSHA_RO when the server has it (Redis 7), so they can run on replicas
+// send runs a command and returns the error the server replied with, if any
+template <typename Send>
+static void RunScript(const char *sha, const char *script, const std::vector<std::string> &args, bool readonly, Send send)
+{
+    readonly = readonly && has_readonly;
+
+    std::vector<std::string> cmd = { readonly ? "EVALSHA_RO" : "EVALSHA", sha };
+    cmd.insert(cmd.end(), args.begin(), args.end());
+
+    std::string error = send(cmd);
+    if (readonly && error.compare(0, 19, "ERR unknown command") == 0) {
+        has_readonly = false;
+        readonly = false;
+
+        cmd[0] = "EVALSHA";
+        error = send(cmd);
+    }
+
+    if (error.compare(0, 8, "NOSCRIPT") == 0) {
+        cmd[0] = readonly ? "EVAL_RO" : "EVAL";
+        cmd[1] = script;
+        send(cmd);
+    }
+}
+
+static std::unique_ptr<async_redis::reply> EvalScript(async_redis::connection *db,
+    const char *sha, const char *script, const std::vector<std::string> &args, bool readonly = false)
+{
+    std::unique_ptr<async_redis::reply> reply;
+    RunScript(sha, script, args, readonly, [&](const std::vector<std::string> &cmd) {
+        reply = db->Command(cmd).get();
+        return reply && reply->IsError() ? std::string(reply->StatusView()) : std::string();
+    });
+
+    return reply;
+}
+
+// Same, with the reply decoded straight into dec, true if it was received and is not an error
+static bool EvalScript(async_redis::connection *db, const char *sha, const char *script,
+    const std::vector<std::string> &args, async_redis::decoder &dec, bool readonly = false)
+{
+    bool received = false;
+    RunScript(sha, script, args, readonly, [&](const std::vector<std::string> &cmd) {
+        received = db->Decode(cmd, &dec).get();
+        return received ? dec.error : std::string();
+    });
+
+    return received && dec.error.empty();
+}
+
+// Reply of GET_CLIENT_COOKIES, flat "id, value, id, value ..." or packed into a single string
+class CookieRowsDecoder : public async_redis::decoder
+{
+public:
+    CookieRowsDecoder(CookieRows &results) : rows(results), id(0)
+    {
+    }
+
+    void Reset() override
+    {
+        decoder::Reset();
+        rows.clear();
+    }
+
+    void Array(int depth, size_t index, size_t elements) override
+    {
+        if (depth == 0) {
+            rows.reserve(elements / 2);
+        }
+    }
+
+    void String(int depth, size_t index, const char *str, size_t len) override
+    {
+        if (depth == 0) {
+            Unpack((const unsigned char *)str, len);
+            return;
+        }
+
+        if (depth != 1) {
+            return;
+        }
+
+        if (index % 2 == 0) {
+            id = 0;
+            std::from_chars(str, str + len, id);
+        } else {
+            rows.emplace_back(id, std::string(str, len));
+        }
+    }
+
+private:
+    // [u32 id][u32 value length][value] ..., little endian
+    void Unpack(const unsigned char *data, size_t len)
+    {
+        const unsigned char *end = data + len;
+        while (end - data >= 8) {
+            uint32_t record_id = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+            uint32_t size = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+            data += 8;
+
+            if ((size_t)(end - data) < size) {
+                break;
+            }
+
+            rows.emplace_back((int)record_id, std::string((const char *)data, size));
+            data += size;
+        }
+    }
+
+    CookieRows &rows;
+    int id;
+};
+
+// MGET reply, the value of the n-th id or nil
+class CookieValuesDecoder : public async_redis::decoder
+{
+public:
+    CookieValuesDecoder(const std::vector<int> &ids, CookieRows &results) :
+        ids(ids), rows(results)
+    {
+    }
+
+    void Reset() override
+    {
+        decoder::Reset();
+        rows.clear();
+    }
+
+    void String(int depth, size_t index, const char *str, size_t len) override
+    {
+        if (depth == 1 && index < ids.size()) {
+            rows.emplace_back(ids[index], std::string(str, len));
+        }
+    }
+
+private:
+    const std::vector<int> &ids;
+    CookieRows &rows;
+};
+
+LatencyHistogram g_QueryStats[Query_Count][QUERY_STAGES];
+
+static const char *const queryNames[Query_Count] = {
+    "InsertCookie", "SelectData", "InsertData", "SelectId", "Connect", "SelectCookie", "InsertBatch", "SelectAuthId",
+};
+
+static const char *const stageNames[QUERY_STAGES] = {
+    "queue", "connect", "redis", "process", "result", "think", "total",
+};
+
+void PrintQueryStats()
+{
+    rootconsole->ConsolePrint("[Clientprefs] Query latency in microseconds, since start or the last reset:");
+
+    for (int type = 0; type < Query_Count; ++type) {
+        uint64_t queries = g_QueryStats[type][QUERY_STAGES - 1].Count();
+        if (queries == 0) {
+            continue;
+        }
+
+        rootconsole->ConsolePrint("  %s, %llu queries", queryNames[type], (unsigned long long)queries);
+        rootconsole->ConsolePrint("    %-8s %10s %10s %10s %10s", "stage", "p50", "p90", "p99", "max");
+
+        for (int stage = 0; stage < QUERY_STAGES; ++stage) {
+            const LatencyHistogram &histogram = g_QueryStats[type][stage];
+            rootconsole->ConsolePrint("    %-8s %10llu %10llu %10llu %10llu", stageNames[stage],
+                (unsigned long long)histogram.Percentile(0.5), (unsigned long long)histogram.Percentile(0.9),
+                (unsigned long long)histogram.Percentile(0.99), (unsigned long long)histogram.Max());
+        }
+    }
+}
+
+void ResetQueryStats()
+{
+    for (auto &stages : g_QueryStats) {
+        for (auto &histogram : stages) {
+            histogram.Reset();
+        }
+    }
+}
+
+void TQueryOp::Stamp(querystamp point)
+{
+    using namespace std::chrono;
+    m_stamps[point] = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
 
  // Only run on main thread
 void TQueryOp::RunThinkPart()
 {
+    Stamp(Stamp_Think);
+
     switch (m_type) {
     case Query_InsertCookie:
     {
-        g_CookieManager.InsertCookieCallback(m_pCookie, m_insertId);
+        g_CookieManager.InsertCookieCallback(m_params.cookies, m_insertIds);
         break;
     }
 
     case Query_SelectData:
     {
-        g_CookieManager.ClientConnectCallback(m_serial, m_results);
+        if (!m_success) {
+            g_CookieManager.ClientLoadFailed(m_serial, m_params);
+            break;
+        }
+
+        g_CookieManager.ClientConnectCallback(m_serial, m_params, m_results);
         break;
     }
 
@@ -61,9 +281,28 @@ void TQueryOp::RunThinkPart()
         break;
     }
 
+    case Query_SelectCookie:
+    {
+        g_CookieManager.CookieDataCallback(m_pCookie, m_results);
+        break;
+    }
+
+    case Query_SelectAuthId:
+    {
+        g_CookieManager.AuthIdReadCallback(m_params.read, m_params, m_results, m_success);
+        break;
+    }
+
+    case Query_InsertBatch:
+    {
+        size_t written = m_success ? m_written : 0;
+        g_CookieManager.BatchWriteCallback(m_params.batch, written, m_params.values.size() - written);
+        break;
+    }
+
     case Query_Connect:
     {
-        return;
+        break;
     }
 
     default:
@@ -71,6 +310,17 @@ void TQueryOp::RunThinkPart()
         break;
     }
     }
+
+    Stamp(Stamp_Done);
+
+    // Stages a query skipped are not counted, the total still is
+    for (int stage = 0; stage < QUERY_STAGES; ++stage) {
+        uint64_t from = stage == QUERY_STAGES - 1 ? m_stamps[Stamp_Enqueue] : m_stamps[stage];
+        uint64_t to = stage == QUERY_STAGES - 1 ? m_stamps[Stamp_Done] : m_stamps[stage + 1];
+        if (from != 0 && to >= from) {
+            g_QueryStats[m_type][stage].Record(to - from);
+        }
+    }
 }
 
 void TQueryOp::RunThreadPart()
@@ -83,7 +333,10 @@ void TQueryOp::RunThreadPart()
     // assert(m_database != NULL);
     /* I don't think this is needed anymore... keeping for now. */
     // m_database->LockForFullAtomicOperation();
-    if (!BindParamsAndRun()) {
+    Stamp(Stamp_Send);
+    m_success = BindParamsAndRun();
+    Stamp(Stamp_Reply);
+    if (!m_success) {
         g_pSM->LogError(myself,
             "Failed Redis Query, Error: \"%s\" (Query id %i - serial %i)",
             m_database->GetErrorString(),
@@ -91,6 +344,13 @@ void TQueryOp::RunThreadPart()
             m_serial);
     }
     // m_database->UnlockFromFullAtomicOperation();
+
+    /* Match the rows to their cookie here, so the main thread only has to store them */
+    if (m_type == Query_SelectData) {
+        g_CookieManager.ResolveRows(m_results);
+    }
+
+    Stamp(Stamp_Result);
 }
 
 //IDBDriver *TQueryOp::GetDriver()
@@ -108,13 +368,22 @@ void TQueryOp::Destroy()
     delete this;
 }
 
+void TQueryOp::OnDequeued()
+{
+    Stamp(Stamp_Dequeue);
+}
+
 TQueryOp::TQueryOp(enum querytype type, int serial)
 {
     m_type = type;
     m_serial = serial;
     m_database = NULL;
+    m_replica = NULL;
     // m_driver = NULL;
     m_insertId = -1;
+    m_success = false;
+    m_written = 0;
+    memset(m_stamps, 0, sizeof(m_stamps));
     // m_pResult = NULL;
 }
 
@@ -123,15 +392,24 @@ TQueryOp::TQueryOp(enum querytype type, Cookie *cookie)
     m_type = type;
     m_pCookie = cookie;
     m_database = NULL;
+    m_replica = NULL;
     // m_driver = NULL;
     m_insertId = -1;
+    m_success = false;
+    m_written = 0;
+    memset(m_stamps, 0, sizeof(m_stamps));
     // m_pResult = NULL;
     m_serial = 0;
 }
 
 void TQueryOp::SetDatabase(void *db)
 {
-    m_database = (async_redis::client *)db;
+    m_database = (async_redis::connection *)db;
+}
+
+void TQueryOp::SetReplica(void *db)
+{
+    m_replica = (async_redis::connection *)db;
 }
 
 bool TQueryOp::BindParamsAndRun()
@@ -139,120 +417,139 @@ bool TQueryOp::BindParamsAndRun()
     switch (m_type) {
     case Query_InsertCookie:
     {
-        std::string safe_name = m_params.cookie->name;
-        std::string safe_desc = m_params.cookie->description;
-
-        // check if we have that cookie
-        {
-            auto reply = m_database->Command({ "GET", "cookies.id." + safe_name }).get();
-            if (reply->IsString()) {
-                m_database->Append({ "SADD", "cookies.list", safe_name }).Commit();
-                m_insertId = std::stoi(reply->GetString());
-                return true;
-            }
+        m_insertIds.clear();
+
+        std::vector<std::string> args = { "1", MetadataKey() };
+        for (Cookie *cookie : m_params.cookies) {
+            args.push_back(cookie->name);
+            args.push_back(cookie->description);
+            args.push_back(std::to_string((int)cookie->access));
         }
 
-        std::hash<std::string> h;
-        m_insertId = h(safe_name) & 0x7FFFFFFF;
+        auto reply = EvalScript(m_database, REGISTER_COOKIES_SHA, REGISTER_COOKIES, args);
+        if (!reply || !reply->IsArrays()) {
+            return false;
+        }
 
-        auto &client = *m_database;
-        client.Append({ "SADD", "cookies.list", safe_name })
-            .Append({ "SET", "cookies.access." + safe_name, std::to_string((int)m_params.cookie->access) })
-            .Append({ "SET", "cookies.desc." + safe_name, safe_desc })
-            .Append({ "SET", "cookies.id." + safe_name, std::to_string(m_insertId) })
-            .Commit();
+        for (const auto &id : reply->GetArray()) {
+            m_insertIds.push_back(id.IsInt() ? (int)id.GetInt() : -1);
+        }
         return true;
     }
 
+    // Players who are not connected are loaded the same way
     case Query_SelectData:
+    case Query_SelectAuthId:
     {
         m_results.clear();
-        std::string steamId = m_params.steamId;
+        std::string steamId = PlayerKey(m_params.steamId);
 
-        // Try to use cached Lua query first
-        auto cookies = m_database->Command({ "EVALSHA", GET_CLIENT_COOKIES_SHA, "1", steamId }).get();
-        if (cookies && cookies->Ok()) {
-            if (!cookies->IsArrays()) {
+        if (m_params.cookieIds.empty()) {
+            return true;
+        }
+
+        // Read before the values, so it never claims more than what was loaded
+        if (m_params.readVersion) {
+            auto version = (m_replica ? m_replica : m_database)->Command({ "GET", VersionKey(m_params.steamId) }).get();
+            m_params.version = version && version->IsString() ? strtoull(version->GetString().c_str(), NULL, 10) : 0;
+
+            // The warm cache already holds these values
+            if (m_params.cachedVersion != 0 && m_params.version == m_params.cachedVersion) {
                 return true;
             }
+        }
 
-            for (const auto &cookieData : cookies->GetArray()) {
-                if (!cookieData.IsArrays() || cookieData.GetArray().size() != 4) {
-                    break;
-                }
+        ValueCache &cache = g_ClientPrefs.valueCache;
+        bool cached = g_ClientPrefs.UseValueCache();
+        uint64_t epoch = cache.Epoch(steamId);
+        if (cached && cache.Lookup(steamId, m_params.cookieIds, m_results)) {
+            return true;
+        }
 
-                const auto &cookie = cookieData.GetArray();
+        std::vector<std::string> args = { "1", steamId };
+        for (int id : m_params.cookieIds) {
+            args.push_back(std::to_string(id));
+        }
 
-                CookieAccess acce;
-                try {
-                    acce = (CookieAccess)std::stoi(cookie[CookieAcce].GetString());
-                } catch (const std::exception&) {
-                    acce = CookieAccess_Public;
-                }
+        // Rows are decoded as they are read, no reply is built for them
+        CookieRowsDecoder rows(m_results);
 
-                std::string value;
-                if (cookie[CookieValue].IsString()) {
-                    value = cookie[CookieValue].GetString();
-                }
+        const char *script = g_ClientPrefs.packedLoad ? GET_CLIENT_COOKIES_PACKED : GET_CLIENT_COOKIES;
+        const char *sha = g_ClientPrefs.packedLoad ? GET_CLIENT_COOKIES_PACKED_SHA : GET_CLIENT_COOKIES_SHA;
 
-                m_results.push_back({
-                    Cookie(
-                        cookie[CookieName].GetString().c_str(),
-                        cookie[CookieDesc].GetString().c_str(),
-                        acce),
-                    value.c_str()
-                        });
-            }
-            return true;
+        // Loads go to a replica when there is one, the primary only gets the writes
+        bool loaded = false;
+        bool replicated = false;
+        if (m_replica) {
+            loaded = replicated = EvalScript(m_replica, sha, script, args, rows, true);
         }
 
-        // Use normal and slow method, if you have too many cookies (>= 10M), you should use the lua method
-        auto keys = m_database->Command({ "KEYS", "cookies.id.*" }).get();
-        if (!keys || !keys->IsArrays()) {
-            return true;
+        // Try to use cached Lua query first
+        if (!loaded) {
+            std::vector<std::string> cmd = { "EVALSHA", sha };
+            cmd.insert(cmd.end(), args.begin(), args.end());
+            loaded = m_database->Decode(cmd, &rows).get() && rows.error.empty();
         }
 
-        for (const auto &item : keys->GetArray()) {
-            std::string cookieName = item.GetString().substr(11);
+        if (!loaded) {
+            // Script is not available, fetch the same keys with a single MGET
+            std::vector<std::string> cmd = { "MGET" };
+            for (int id : m_params.cookieIds) {
+                cmd.push_back(steamId + "." + std::to_string(id));
+            }
 
-            auto cookie_id = m_database->Command({ "GET", item.GetString() }).get();
-            if (!cookie_id->IsString()) {
-                g_pSM->LogError(myself, "Expect %s to be REDIS_REPLY_STRING but got %d", item.GetString().c_str(), cookie_id->Type());
-                continue;
+            CookieValuesDecoder values(m_params.cookieIds, m_results);
+            if (!m_database->Decode(cmd, &values).get() || !values.error.empty()) {
+                return false;
             }
+        }
 
-            std::string key_name = steamId + "." + cookie_id->GetString();
-            std::string key_desc = "cookies.desc." + cookieName;
-            std::string key_id = "cookies.access." + cookieName;
+        // A replica can lag behind the invalidations we get from the primary
+        if (cached && !replicated) {
+            cache.Insert(steamId, m_params.cookieIds, m_results, epoch);
+        }
+        m_params.replicated = replicated;
 
-            auto _value = m_database->Command({ "GET", key_name }, false);
-            auto _desc = m_database->Command({ "GET", key_desc }, false);
-            auto _access = m_database->Command({ "GET", key_id }, false);
-            m_database->Commit();
+        return true;
+    }
 
-            auto value = _value.get();
-            auto desc = _desc.get();
-            auto access = _access.get();
+    case Query_SelectCookie:
+    {
+        m_results.clear();
 
-            CookieAccess acce;
-            try {
-                acce = (CookieAccess)std::stoi(access->GetString());
-            } catch (const std::exception&) {
-                acce = CookieAccess_Public;
+        if (m_database->IsCluster()) {
+            // Every player lives in their own slot, pipeline a GET each instead
+            std::vector<std::future<std::unique_ptr<async_redis::reply>>> values;
+            for (const auto &[serial, steamId] : m_params.players) {
+                values.push_back(m_database->Command({ "GET", ValueKey(steamId.c_str(), m_params.cookieId) }, false));
             }
+            m_database->Commit();
 
-            std::string cookie_value;
-            if (value->IsString()) {
-                cookie_value = value->GetString();
+            for (size_t i = 0; i < values.size(); ++i) {
+                auto value = values[i].get();
+                if (value && value->IsString()) {
+                    m_results.emplace_back(m_params.players[i].first, std::move(value->GetString()));
+                }
             }
 
-            m_results.push_back({
-                Cookie(
-                    cookieName.c_str(),
-                    desc->GetString().c_str(),
-                    acce),
-                cookie_value.c_str()
-                });
+            return true;
+        }
+
+        std::vector<std::string> cmd = { "MGET" };
+        for (const auto &[serial, steamId] : m_params.players) {
+            cmd.push_back(ValueKey(steamId.c_str(), m_params.cookieId));
+        }
+
+        auto values = m_database->Command(cmd).get();
+        if (!values || !values->IsArrays()) {
+            return false;
+        }
+
+        auto &rows = values->GetArray();
+        for (size_t i = 0; i < rows.size() && i < m_params.players.size(); ++i) {
+            if (rows[i].IsString()) {
+                m_results.emplace_back(m_params.players[i].first, std::move(rows[i].GetString()));
+            }
         }
 
         return true;
@@ -261,34 +558,100 @@ bool TQueryOp::BindParamsAndRun()
     case Query_InsertData:
     {
         std::string safe_id = m_params.steamId;
-        std::string safe_val = m_params.data->value;
+        std::string safe_val = m_params.value;
 
         int cookieId = m_params.cookieId;
-        safe_id = safe_id + "." + std::to_string(cookieId);
+        std::string key = ValueKey(safe_id.c_str(), cookieId);
+
+        // Do not wait for Redis to tell us about our own write
+        if (g_ClientPrefs.tracking) {
+            g_ClientPrefs.valueCache.Invalidate(key);
+        }
 
-        m_database->Append({ "SET", safe_id, safe_val, "EX", "1209600" }).Commit(); // Set this key expire in 2 weeks
+        // Set this key expire in 2 weeks, with invalidation the other servers update the values they hold
+        EvalScript(m_database, SET_COOKIE_DATA_SHA, SET_COOKIE_DATA, {
+            "2", key, VersionKey(safe_id.c_str()), safe_val, "1209600",
+            g_ClientPrefs.invalidation ? g_ClientPrefs.invalidationChannel : "", g_ClientPrefs.invalidationOrigin,
+            safe_id, std::to_string(cookieId)
+            });
         return true;
     }
 
-    case Query_SelectId:
+    case Query_InsertBatch:
     {
-        std::string safe_name = m_params.steamId;
+        m_written = 0;
+
+        int cookieId = m_params.cookieId;
+        auto command = [&](const std::string &steamId, const std::string &value) -> std::vector<std::string> {
+            std::string key = ValueKey(steamId.c_str(), cookieId);
 
-        std::hash<std::string> h;
-        int id = h(safe_name) & 0x7FFFFFFF;
+            if (g_ClientPrefs.tracking) {
+                g_ClientPrefs.valueCache.Invalidate(key);
+            }
 
-        auto rep = m_database->Command({ "GET", "cookies.id." + safe_name }).get();
-        if (rep->IsString()) {
-            return false;
+            return { "EVALSHA", SET_COOKIE_DATA_SHA, "2", key, VersionKey(steamId.c_str()), value, "1209600",
+                g_ClientPrefs.invalidation ? g_ClientPrefs.invalidationChannel : "", g_ClientPrefs.invalidationOrigin,
+                steamId, std::to_string(cookieId) };
+        };
+
+        std::vector<size_t> writes(m_params.values.size());
+        for (size_t i = 0; i < writes.size(); ++i) {
+            writes[i] = i;
         }
 
-        m_insertId = std::stoi(rep->GetString());
-        if (id != m_insertId) {
-            g_pSM->LogError(myself, "Cookies ID does not match %d vs %d", id, m_insertId);
+        for (int attempt = 0; !writes.empty(); ++attempt) {
+            // The whole chunk goes out before the first reply is read
+            std::vector<std::future<std::unique_ptr<async_redis::reply>>> replies;
+            replies.reserve(writes.size());
+            for (size_t i : writes) {
+                replies.push_back(m_database->Command(command(m_params.values[i].first, m_params.values[i].second), false));
+            }
+            m_database->Commit();
+
+            std::vector<size_t> noscript;
+            for (size_t i = 0; i < replies.size(); ++i) {
+                auto reply = replies[i].get();
+                if (reply && reply->IsError() && reply->StatusView().compare(0, 8, "NOSCRIPT") == 0) {
+                    noscript.push_back(writes[i]);
+                } else if (reply && !reply->IsError()) {
+                    m_written++;
+                }
+            }
+
+            // The server lost the script, load it once and pipeline the refused writes again
+            if (noscript.empty() || attempt > 0) {
+                break;
+            }
+
+            auto loaded = m_database->Command({ "SCRIPT", "LOAD", SET_COOKIE_DATA }).get();
+            if (!loaded || !loaded->IsString()) {
+                break;
+            }
+
+            writes = std::move(noscript);
+        }
+
+        return true;
+    }
+
+    case Query_SelectId:
+    {
+        std::string safe_name = m_params.steamId;
+
+        auto rep = m_database->Command({ "GET", std::string(MetadataKey()) + ".id." + safe_name }).get();
+        if (!rep || !rep->IsString()) {
+            return false;
         }
 
+        m_insertId = atoi(rep->GetString().c_str());
         return true;
     }
+
+    // Query_Connect is run by RunThreadPart, Query_Count is not a query
+    default:
+    {
+        break;
+    }
     }
 
     return false;
@@ -304,19 +667,17 @@ int TQueryOp::PullQuerySerial()
     return m_serial;
 }
 
-ParamData::~ParamData()
-{
-    if (data) {
-        /* Data is only ever passed in a client disconnect query and always needs to be deleted */
-        delete data;
-        data = NULL;
-    }
-}
-
 ParamData::ParamData()
 {
     cookie = NULL;
-    data = NULL;
+    batch = NULL;
+    read = NULL;
     steamId[0] = '\0';
     cookieId = 0;
+    readVersion = false;
+    cachedVersion = 0;
+    version = 0;
+    storeClock = 0;
+    reload = false;
+    replicated = false;
 }
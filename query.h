@@ -34,34 +34,129 @@
 
 #include "extension.h"
 #include "cookie.h"
+#include "stats.h"
 #include <sh_string.h>
 
 #include <map>
 #include <vector>
 #include <string>
 
-#define GET_CLIENT_COOKIES R"(local a={}for b,c in ipairs(redis.call('SMEMBERS','cookies.list'))do local d=redis.call('GET','cookies.id.'..c)if d==false then redis.call('SREM','cookies.list',c)else table.insert(a,{c,redis.call('GET',string.format('cookies.desc.%s',c)),redis.call('GET',string.format('cookies.access.%s',c)),redis.call('GET',string.format('%s.%s',KEYS[1],d))})end end;return a)"
-#define GET_CLIENT_COOKIES_SHA "2e80a3ad95e151c8466c622a382586fab9d9f9b1"
+#define GET_CLIENT_COOKIES R"(local a={}for b,c in ipairs(ARGV)do local d=redis.call('GET',KEYS[1]..'.'..c)if d then a[#a+1]=c a[#a+1]=d end end;return a)"
+#define GET_CLIENT_COOKIES_SHA "aa5cf9d9730dc88781bdbee352568c4b9e931edc"
 
  /*
--- local cookies = {}
+-- KEYS[1]: steamid, ARGV: ids of the cookies registered on this server
+-- Returns a flat array of id, value for every cookie the player has a value for
+-- Read only, so it can run on a replica (EVALSHA_RO)
 
--- for idx, name in ipairs(redis.call('SMEMBERS', 'cookies.list')) do
---     local id = redis.call('GET', 'cookies.id.' .. name)
---     if id == false then
---         redis.call('SREM', 'cookies.list', name)
+-- local result = {}
+
+-- for idx, id in ipairs(ARGV) do
+--     local value = redis.call('GET', KEYS[1] .. '.' .. id)
+--     if value then
+--         result[#result + 1] = id
+--         result[#result + 1] = value
+--     end
+-- end
+
+-- return result
+ */
+
+#define GET_CLIENT_COOKIES_PACKED R"(local a={}for b,c in ipairs(ARGV)do local d=redis.call('GET',KEYS[1]..'.'..c)if d then a[#a+1]=struct.pack('<I4I4',tonumber(c),#d)..d end end;return table.concat(a))"
+#define GET_CLIENT_COOKIES_PACKED_SHA "79b8a7801fd48f57a9463c138671fd4bbb6e89c2"
+
+ /*
+-- Same as GET_CLIENT_COOKIES, packed into a single bulk string to save the framing of
+-- thousands of bulk strings: [u32 id][u32 value length][value] ..., little endian
+
+-- local records = {}
+
+-- for idx, id in ipairs(ARGV) do
+--     local value = redis.call('GET', KEYS[1] .. '.' .. id)
+--     if value then
+--         records[#records + 1] = struct.pack('<I4I4', tonumber(id), #value) .. value
+--     end
+-- end
+
+-- return table.concat(records)
+ */
+
+#define REGISTER_COOKIES R"(local a={}local k=KEYS[1]if redis.call('SETNX',k..'.migrated',1)==1 then local e=tonumber(redis.call('GET',k..'.nextid'))or 0 for f,c in ipairs(redis.call('SMEMBERS',k..'.list'))do local d=redis.call('GET',k..'.id.'..c)if d then redis.call('HSETNX',k..'.ids',d,c)e=math.max(e,tonumber(d)or 0)end end redis.call('SET',k..'.nextid',e)end for b=1,#ARGV,3 do local c=ARGV[b]local d=redis.call('GET',k..'.id.'..c)if d then redis.call('HSETNX',k..'.ids',d,c)else repeat d=tostring(redis.call('INCR',k..'.nextid'))until redis.call('HSETNX',k..'.ids',d,c)==1 redis.call('SET',k..'.id.'..c,d)redis.call('SET',k..'.desc.'..c,ARGV[b+1])redis.call('SET',k..'.access.'..c,ARGV[b+2])end redis.call('SADD',k..'.list',c)a[#a+1]=tonumber(d)end;return a)"
+#define REGISTER_COOKIES_SHA "2dac0939453e7e009c381e82b7e100f0d376c22f"
+
+ /*
+-- KEYS[1]: metadata prefix ("cookies"), ARGV: name, description, access [, name, description, access ...]
+-- Returns the id of every cookie, ids are allocated by the server so they are the same
+-- on every platform, and cookies.ids (id -> name) makes sure an id is never handed out twice.
+-- The first call claims the ids of every cookie registered before that, so INCR never hands
+-- out one of them, and cookies.migrated marks it as done
+
+-- local ids = {}
+-- local prefix = KEYS[1]
+
+-- if redis.call('SETNX', prefix .. '.migrated', 1) == 1 then
+--     local top = tonumber(redis.call('GET', prefix .. '.nextid')) or 0
+--     for _, name in ipairs(redis.call('SMEMBERS', prefix .. '.list')) do
+--         local id = redis.call('GET', prefix .. '.id.' .. name)
+--         if id then
+--             redis.call('HSETNX', prefix .. '.ids', id, name)
+--             top = math.max(top, tonumber(id) or 0)
+--         end
+--     end
+--     redis.call('SET', prefix .. '.nextid', top)
+-- end
+
+-- for i = 1, #ARGV, 3 do
+--     local name = ARGV[i]
+--     local id = redis.call('GET', prefix .. '.id.' .. name)
+--     if id then
+--         -- Cookies registered since, by servers still running the old version, are claimed here
+--         redis.call('HSETNX', prefix .. '.ids', id, name)
 --     else
---         table.insert(cookies, {
---             name,
---             redis.call('GET', string.format('cookies.desc.%s', name)),
---             redis.call('GET', string.format('cookies.access.%s', name)),
---             redis.call('GET', string.format('%s.%s', KEYS[1], id))
---         })
+--         repeat
+--             id = tostring(redis.call('INCR', prefix .. '.nextid'))
+--         until redis.call('HSETNX', prefix .. '.ids', id, name) == 1
+--         redis.call('SET', prefix .. '.id.' .. name, id)
+--         redis.call('SET', prefix .. '.desc.' .. name, ARGV[i + 1])
+--         redis.call('SET', prefix .. '.access.' .. name, ARGV[i + 2])
 --     end
+--     redis.call('SADD', prefix .. '.list', name)
+--     ids[#ids + 1] = tonumber(id)
 -- end
 
--- return cookies
+-- return ids
+ */
+
+#define SET_COOKIE_DATA R"(local a=redis.call('INCR',KEYS[2])redis.call('EXPIRE',KEYS[2],ARGV[2])redis.call('SET',KEYS[1],ARGV[1],'EX',ARGV[2])if ARGV[3]~=''then redis.call('PUBLISH',ARGV[3],ARGV[4]..' '..a..' '..ARGV[6]..' '..ARGV[5]..' '..(#ARGV[1]>512 and '-' or '+'..ARGV[1]))end;return a)"
+#define SET_COOKIE_DATA_SHA "cce90a53c6832a9d4ea076487a1e7737270a5892"
+
+ /*
+-- KEYS[1]: steamid.id, KEYS[2]: version counter, ARGV: value, ttl, channel, origin, steamid, id
+-- Sets the value and bumps the version of the player's values, which lives as long as they do.
+-- With a channel every other server is told about it: "origin version id steamid +value",
+-- large values are not sent along ("origin version id steamid -") and have to be fetched
+
+-- local version = redis.call('INCR', KEYS[2])
+-- redis.call('EXPIRE', KEYS[2], ARGV[2])
+-- redis.call('SET', KEYS[1], ARGV[1], 'EX', ARGV[2])
+-- if ARGV[3] ~= '' then
+--     redis.call('PUBLISH', ARGV[3], ARGV[4] .. ' ' .. version .. ' ' .. ARGV[6] .. ' ' .. ARGV[5] .. ' ' ..
+--         (#ARGV[1] > 512 and '-' or '+' .. ARGV[1]))
+-- end
+-- return version
+ */
+
+/**
+ * Redis key names
+ *
+ * In cluster mode every key of a player is hash tagged with their auth id ("{STEAM_0:1:2}.5")
+ * and all the cookie metadata with "{cookies}", so loading or saving a player and registering
+ * cookies each stay on a single node.
  */
+std::string PlayerKey(const char *steamId);
+std::string ValueKey(const char *steamId, int cookieId);
+std::string VersionKey(const char *steamId);
+const char *MetadataKey();
 
 enum querytype
 {
@@ -70,10 +165,36 @@ enum querytype
     Query_InsertData,
     Query_SelectId,
     Query_Connect,
+    Query_SelectCookie,
+    Query_InsertBatch,
+    Query_SelectAuthId,
+    Query_Count,
 };
 
+/* Points every query is timestamped at, the time between two of them is a stage */
+enum querystamp
+{
+    Stamp_Enqueue = 0,  /* Added to the queue */
+    Stamp_Dequeue,      /* Taken by a query thread */
+    Stamp_Send,         /* Connection checked, talking to Redis */
+    Stamp_Reply,        /* Done with Redis */
+    Stamp_Result,       /* Put on the result queue */
+    Stamp_Think,        /* Taken by the game frame */
+    Stamp_Done,
+    Stamp_Count,
+};
+
+/* One per stage, and the whole way from Stamp_Enqueue to Stamp_Done */
+#define QUERY_STAGES Stamp_Count
+
+/* Latency of every stage of every query type, recorded once a query is done */
+extern LatencyHistogram g_QueryStats[Query_Count][QUERY_STAGES];
+void PrintQueryStats();
+void ResetQueryStats();
+
 struct Cookie;
-struct CookieData;
+struct BatchWrite;
+struct AuthIdRead;
 #define MAX_NAME_LENGTH 30
 
 /* This stores all the info required for our param binding until the thread is executed */
@@ -81,15 +202,37 @@ struct ParamData
 {
     ParamData();
 
-    ~ParamData();
-
     /* Contains a name, description and access for InsertCookie queries */
     Cookie *cookie;
+    /* Every cookie registered within a frame, registered by a single InsertCookie query */
+    std::vector<Cookie *> cookies;
     /* A clients steamid - Used for most queries - Doubles as storage for the cookie name*/
     char steamId[MAX_NAME_LENGTH];
 
     int cookieId;
-    CookieData *data;
+    /* The value written by InsertData queries */
+    std::string value;
+
+    /* Ids of the cookies to load for SelectData and SelectAuthId queries */
+    std::vector<int> cookieIds;
+    /* SelectData: read the version of the values first, nothing is loaded if it still is cachedVersion */
+    bool readVersion;
+    uint64_t cachedVersion;
+    uint64_t version;
+    /* SelectData: CookieManager::storeClock when queued, values stored after that are kept */
+    uint64_t storeClock;
+    /* SelectData: reload of a client whose cookies are cached, invalidations for it were missed */
+    bool reload;
+    /* SelectData and SelectAuthId: the values were read from a replica, which may lag behind */
+    bool replicated;
+    /* Serial and auth id of every player to load a single cookie for, SelectCookie queries */
+    std::vector<std::pair<int, std::string>> players;
+
+    /* Auth id and value of every write of an InsertBatch query, and the batch it belongs to */
+    std::vector<std::pair<std::string, std::string>> values;
+    BatchWrite *batch;
+    /* The plugin read a SelectAuthId query answers */
+    AuthIdRead *read;
 };
 
 class TQueryOp : public IThreadQuery
@@ -103,9 +246,13 @@ public:
     IdentityToken_t *GetOwner();
 
     void SetDatabase(void *db);
+    /* Read only connection for loads, NULL to use the primary */
+    void SetReplica(void *db);
 
     void Destroy();
 
+    void OnDequeued();
+
     void RunThreadPart();
     /* Thread has been cancelled due to driver unloading. Nothing else to do? */
     void CancelThinkPart() {}
@@ -113,10 +260,12 @@ public:
 
     bool BindParamsAndRun();
 
+    void Stamp(querystamp point);
+
     /* Params to be bound */
     ParamData m_params;
 
-    inline async_redis::client *GetDB()
+    inline async_redis::connection *GetDB()
     {
         return m_database;
     }
@@ -126,10 +275,12 @@ public:
     int PullQuerySerial();
 
 private:
-    async_redis::client *m_database;
+    async_redis::connection *m_database;
+    async_redis::connection *m_replica;
     // IDBDriver *m_driver;
     // IQuery *m_pResult;
-    std::vector<std::tuple<Cookie, std::string>> m_results;
+    /* SelectData, SelectAuthId: cookie id and value, SelectCookie: client serial and value */
+    CookieRows m_results;
 
     /* Query type */
     enum querytype m_type;
@@ -137,6 +288,12 @@ private:
     /* Data to be passed to the callback */
     int m_serial;
     int m_insertId;
+    bool m_success;
+    /* Writes of an InsertBatch query which succeeded */
+    size_t m_written;
+    /* Microseconds on a steady clock, 0 if the point was never reached */
+    uint64_t m_stamps[Stamp_Count];
+    std::vector<int> m_insertIds;
     Cookie *m_pCookie;
 };
 
@@ -2,6 +2,8 @@
 
 #include <hiredis/hiredis.h>
 
+#include <stdexcept>
+
 #include <windows.h>
 
 namespace async_redis
@@ -18,35 +20,38 @@ reply::reply(void *raw_reply)
 
     int_val = r->integer;
 
-    if (r->len && r->str) {
-        str_val = std::string(r->str);
+    if (r->len > 0 && r->str) {
+        str_val.assign(r->str, r->len);
     }
 
     if (reply_type == type::arrays && r->elements && r->element) {
+        rows.reserve(r->elements);
         for (size_t i = 0; i < r->elements; ++i) {
             rows.emplace_back(r->element[i]);
         }
     }
 }
 
-//reply::reply(reply &&other) noexcept
-//{
-//    reply_type = other.reply_type;
-//    rows = std::move(other.rows);
-//    str_val = std::move(other.str_val);
-//    int_val = other.int_val;
-//}
-//
-//reply &reply::operator=(reply &&other) noexcept
-//{
-//    if (this != &other) {
-//        reply_type = other.reply_type;
-//        rows = std::move(other.rows);
-//        str_val = std::move(other.str_val);
-//        int_val = other.int_val;
-//    }
-//    return *this;
-//}
+reply::reply(reply &&other) noexcept :
+    reply_type(other.reply_type),
+    rows(std::move(other.rows)),
+    str_val(std::move(other.str_val)),
+    int_val(other.int_val)
+{
+    other.reply_type = type::invalid;
+}
+
+reply &reply::operator=(reply &&other) noexcept
+{
+    if (this != &other) {
+        reply_type = other.reply_type;
+        rows = std::move(other.rows);
+        str_val = std::move(other.str_val);
+        int_val = other.int_val;
+        other.reply_type = type::invalid;
+    }
+    return *this;
+}
 
 reply::operator bool() const
 {
@@ -92,6 +97,14 @@ int64_t reply::GetInt() const
     return int_val;
 }
 
+std::vector<reply> &reply::GetArray()
+{
+    if (reply_type != type::arrays) {
+        throw std::invalid_argument("Redis reply type does not match");
+    }
+    return rows;
+}
+
 const std::string &reply::GetString() const
 {
     if (reply_type != type::string) {
@@ -99,4 +112,28 @@ const std::string &reply::GetString() const
     }
     return str_val;
 }
+
+std::string &reply::GetString()
+{
+    if (reply_type != type::string) {
+        throw std::invalid_argument("Redis reply type does not match");
+    }
+    return str_val;
+}
+
+std::string_view reply::GetStringView() const
+{
+    if (reply_type != type::string) {
+        throw std::invalid_argument("Redis reply type does not match");
+    }
+    return str_val;
+}
+
+std::string_view reply::StatusView() const
+{
+    if (reply_type == type::status || reply_type == type::error) {
+        return str_val;
+    }
+    return std::string_view();
+}
 }
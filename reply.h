@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace async_redis
@@ -19,10 +20,15 @@ public:
         error,
     };
 
+    // Copies the content of a hiredis reply, strings keep their length so binary values survive
     reply(void *raw_reply);
 
-    //reply(reply &&other) noexcept;
-    //reply &operator=(reply &&other) noexcept;
+    reply(reply &&other) noexcept;
+    reply &operator=(reply &&other) noexcept;
+
+    // Arrays can be large, never copy them by accident
+    reply(const reply &) = delete;
+    reply &operator=(const reply &) = delete;
 
     operator bool() const;
 
@@ -32,10 +38,16 @@ public:
 
     bool Ok() const;
     const char * Status() const;
+    std::string_view StatusView() const;
 
     const std::vector<reply> &GetArray() const;
     int64_t GetInt() const;
     const std::string &GetString() const;
+    std::string_view GetStringView() const;
+
+    // Non-const access lets the caller move values out instead of copying them
+    std::vector<reply> &GetArray();
+    std::string &GetString();
 
     bool IsVaild() const
     {
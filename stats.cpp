@@ -0,0 +1,90 @@
+#include "stats.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline size_t HighestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanReverse64(&bit, value);
+    return bit;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    Reset();
+}
+
+void LatencyHistogram::Record(uint64_t us)
+{
+    buckets[Bucket(us)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t seen = max.load(std::memory_order_relaxed);
+    while (us > seen && !max.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::Percentile(double fraction) const
+{
+    uint64_t total = Count();
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(fraction * total);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < Buckets; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // Never report more than what was actually recorded
+            uint64_t bound = UpperBound(i);
+            return bound < Max() ? bound : Max();
+        }
+    }
+
+    return Max();
+}
+
+void LatencyHistogram::Reset()
+{
+    for (auto &bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::Bucket(uint64_t us)
+{
+    if (us < SubBuckets) {
+        return (size_t)us;
+    }
+
+    // The top SubBits bits below the highest one pick the bucket within its power of two
+    size_t exponent = HighestBit(us);
+    size_t mantissa = (size_t)(us >> (exponent - SubBits)) & (SubBuckets - 1);
+    size_t bucket = (exponent - SubBits + 1) * SubBuckets + mantissa;
+
+    return bucket < Buckets ? bucket : Buckets - 1;
+}
+
+uint64_t LatencyHistogram::UpperBound(size_t bucket)
+{
+    if (bucket < SubBuckets) {
+        return bucket;
+    }
+
+    size_t shift = bucket / SubBuckets - 1;
+    uint64_t lower = (uint64_t)(SubBuckets + bucket % SubBuckets) << shift;
+    return lower + ((uint64_t)1 << shift) - 1;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+
+/**
+ * A latency histogram with fixed log-linear buckets, in microseconds
+ *
+ * Values under 8 are counted exactly, above that every power of two is split in
+ * 8 buckets, so a percentile is off by at most 12.5%. Recording is a few relaxed
+ * atomic increments and can be done from any thread.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void Record(uint64_t us);
+
+    uint64_t Count() const
+    {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Max() const
+    {
+        return max.load(std::memory_order_relaxed);
+    }
+
+    // Upper bound of the bucket holding the given fraction (0.5 for p50) of the values
+    uint64_t Percentile(double fraction) const;
+
+    void Reset();
+
+private:
+    static const size_t SubBits = 3;
+    static const size_t SubBuckets = 1 << SubBits;
+    // Enough for values up to 2^40 us, about 12 days
+    static const size_t Buckets = (40 - SubBits + 2) * SubBuckets;
+
+    static size_t Bucket(uint64_t us);
+    static uint64_t UpperBound(size_t bucket);
+
+    std::atomic<uint64_t> buckets[Buckets];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> max;
+};
@@ -0,0 +1,195 @@
+extern "C" {
+#ifdef _WIN32
+#define WIN32_INTEROP_APIS_H
+#define NO_QFORKIMPL
+#include <Win32_Interop/win32fixes.h>
+
+#pragma comment(lib, "hiredis.lib")
+#pragma comment(lib, "Win32_Interop.lib")
+#endif
+}
+
+#include <hiredis/hiredis.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include <chrono>
+using namespace std::chrono_literals;
+
+#include "subscriber.h"
+
+namespace async_redis
+{
+subscriber::subscriber() : port(0), ctx(nullptr)
+{
+    connected = false;
+    stopped = true;
+}
+
+subscriber::~subscriber()
+{
+    Stop();
+}
+
+bool subscriber::Start(const std::string &_host, int _port, const std::string &_pass,
+    const std::vector<std::string> &_channels, const message_callback &_callback,
+    const std::vector<std::string> &tracking_prefixes, const connect_callback &_on_connect)
+{
+    Stop();
+
+    host = _host;
+    port = _port;
+    pass = _pass;
+    channels = _channels;
+    prefixes = tracking_prefixes;
+    callback = _callback;
+    on_connect = _on_connect;
+
+    stopped = false;
+    worker = std::thread([this] {
+        while (!stopped) {
+            if (!ctx) {
+                if (!Connect()) {
+                    std::this_thread::sleep_for(3s);
+                    continue;
+                }
+
+                if (on_connect) {
+                    on_connect();
+                }
+            }
+
+            redisReply *reply = nullptr;
+            if (redisGetReply(ctx, (void **)&reply) != REDIS_OK) {
+                // Read timed out, nothing was consumed so the connection is still usable
+                if (ctx->err == REDIS_ERR_IO && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ETIMEDOUT)) {
+                    ctx->err = 0;
+                    ctx->errstr[0] = '\0';
+                    continue;
+                }
+
+                connected = false;
+                redisFree(ctx);
+                ctx = nullptr;
+                continue;
+            }
+
+            // [ "message", channel, payload ]
+            if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 3
+                && reply->element[0]->type == REDIS_REPLY_STRING
+                && strcmp(reply->element[0]->str, "message") == 0
+                && reply->element[1]->type == REDIS_REPLY_STRING) {
+                std::string channel(reply->element[1]->str, reply->element[1]->len);
+                redisReply *payload = reply->element[2];
+
+                if (payload->type == REDIS_REPLY_STRING) {
+                    callback(channel, std::string(payload->str, payload->len));
+                } else if (payload->type == REDIS_REPLY_ARRAY) {
+                    // Tracking invalidation, a list of keys
+                    for (size_t i = 0; i < payload->elements; ++i) {
+                        if (payload->element[i]->type == REDIS_REPLY_STRING) {
+                            callback(channel, std::string(payload->element[i]->str, payload->element[i]->len));
+                        }
+                    }
+                } else if (payload->type == REDIS_REPLY_NIL) {
+                    // Tracking invalidation, the whole database was flushed
+                    callback(channel, std::string());
+                }
+            }
+
+            freeReplyObject(reply);
+        }
+
+        connected = false;
+        if (ctx) {
+            redisFree(ctx);
+            ctx = nullptr;
+        }
+    });
+
+    return true;
+}
+
+void subscriber::Stop()
+{
+    stopped = true;
+
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool subscriber::Connect()
+{
+    struct timeval timeout = { 3, 0 };
+    ctx = redisConnectWithTimeout(host.c_str(), port, timeout);
+    if (ctx == nullptr || ctx->err) {
+        if (ctx) {
+            redisFree(ctx);
+            ctx = nullptr;
+        }
+        return false;
+    }
+
+    auto command = [this](const std::vector<std::string> &argv) {
+        std::vector<const char *> args;
+        std::vector<size_t> lens;
+        for (const auto &arg : argv) {
+            args.push_back(arg.c_str());
+            lens.push_back(arg.size());
+        }
+
+        redisReply *reply = (redisReply *)redisCommandArgv(ctx, (int)args.size(), args.data(), lens.data());
+        bool ok = reply != nullptr && reply->type != REDIS_REPLY_ERROR;
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return ok;
+    };
+
+    if (!pass.empty() && !command({ "AUTH", pass })) {
+        redisFree(ctx);
+        ctx = nullptr;
+        return false;
+    }
+
+    if (!prefixes.empty()) {
+        redisReply *reply = (redisReply *)redisCommand(ctx, "CLIENT ID");
+        long long id = reply && reply->type == REDIS_REPLY_INTEGER ? reply->integer : -1;
+        if (reply) {
+            freeReplyObject(reply);
+        }
+
+        // Broadcast mode, we get told about every change under the prefixes, including ones made by scripts
+        std::vector<std::string> tracking = { "CLIENT", "TRACKING", "on", "REDIRECT", std::to_string(id), "BCAST" };
+        for (const auto &prefix : prefixes) {
+            tracking.push_back("PREFIX");
+            tracking.push_back(prefix);
+        }
+
+        if (id < 0 || !command(tracking)) {
+            redisFree(ctx);
+            ctx = nullptr;
+            return false;
+        }
+    }
+
+    std::vector<std::string> subscribe = { "SUBSCRIBE" };
+    subscribe.insert(subscribe.end(), channels.begin(), channels.end());
+
+    // Every channel gets its own confirmation, the first one is read here
+    if (!command(subscribe)) {
+        redisFree(ctx);
+        ctx = nullptr;
+        return false;
+    }
+
+    // Wake up once in a while to check if we should stop
+    struct timeval poll = { 1, 0 };
+    redisSetTimeout(ctx, poll);
+
+    connected = true;
+    return true;
+}
+}
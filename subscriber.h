@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+
+struct redisContext;
+
+namespace async_redis
+{
+/**
+ * A dedicated connection in SUBSCRIBE mode
+ *
+ * Messages are delivered on the subscriber thread, the connection is re-established
+ * (and the channels subscribed again) whenever it drops.
+ *
+ * The connection can also receive client side caching invalidations: with tracking
+ * prefixes set it enables broadcast CLIENT TRACKING redirected to itself, subscribe
+ * to "__redis__:invalidate" to get them. Every invalidated key is delivered as its
+ * own message, an empty message means everything was flushed.
+ */
+class subscriber
+{
+public:
+    // channel, message
+    typedef std::function<void(const std::string &, const std::string &)> message_callback;
+    typedef std::function<void()> connect_callback;
+
+    subscriber();
+    ~subscriber();
+
+    /**
+     * @param tracking_prefixes Key prefixes to track, empty to disable tracking
+     * @param on_connect        Called after every (re)connect, anything published
+     *                          while disconnected was missed
+     */
+    bool Start(const std::string &host, int port, const std::string &pass,
+        const std::vector<std::string> &channels, const message_callback &callback,
+        const std::vector<std::string> &tracking_prefixes = {}, const connect_callback &on_connect = nullptr);
+
+    void Stop();
+
+    bool IsConnected() const
+    {
+        return connected;
+    }
+
+private:
+    bool Connect();
+
+    std::string host;
+    int port;
+    std::string pass;
+    std::vector<std::string> channels;
+    std::vector<std::string> prefixes;
+    message_callback callback;
+    connect_callback on_connect;
+
+    std::atomic<bool> connected;
+    std::atomic<bool> stopped;
+    std::thread worker;
+
+    redisContext *ctx;
+};
+}
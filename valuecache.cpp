@@ -0,0 +1,134 @@
+#include "valuecache.h"
+
+#include <algorithm>
+
+ValueCache::ValueCache() : capacity(4096)
+{
+    hits = 0;
+    misses = 0;
+    invalidations = 0;
+    keys_saved = 0;
+
+    for (auto &epoch : epochs) {
+        epoch = 0;
+    }
+}
+
+void ValueCache::SetCapacity(size_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    capacity = size;
+
+    while (players.size() > capacity) {
+        Erase(lru.back());
+    }
+}
+
+bool ValueCache::Lookup(const std::string &player, const std::vector<int> &ids, rows &out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto iter = players.find(player);
+    if (iter == players.end()) {
+        ++misses;
+        return false;
+    }
+
+    entry &cached = iter->second;
+    for (int id : ids) {
+        if (!std::binary_search(cached.known.begin(), cached.known.end(), id)) {
+            ++misses;
+            return false;
+        }
+    }
+
+    for (int id : ids) {
+        auto value = cached.values.find(id);
+        if (value != cached.values.end()) {
+            out.emplace_back(id, std::string(value->second));
+        }
+    }
+
+    lru.splice(lru.begin(), lru, cached.lru);
+
+    ++hits;
+    keys_saved += ids.size();
+    return true;
+}
+
+void ValueCache::Insert(const std::string &player, const std::vector<int> &ids, const rows &values, uint64_t since)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    // The player changed while we were reading, the values might already be outdated
+    if (epochs[Slot(player)] != since || capacity == 0) {
+        return;
+    }
+
+    auto iter = players.find(player);
+    if (iter == players.end()) {
+        if (players.size() >= capacity) {
+            Erase(lru.back());
+        }
+
+        lru.push_front(player);
+        iter = players.emplace(player, entry()).first;
+        iter->second.lru = lru.begin();
+    } else {
+        lru.splice(lru.begin(), lru, iter->second.lru);
+    }
+
+    entry &cached = iter->second;
+    for (int id : ids) {
+        cached.values.erase(id);
+        cached.known.push_back(id);
+    }
+
+    std::sort(cached.known.begin(), cached.known.end());
+    cached.known.erase(std::unique(cached.known.begin(), cached.known.end()), cached.known.end());
+
+    for (const CookieRow &row : values) {
+        cached.values[row.id] = row.value;
+    }
+}
+
+void ValueCache::Invalidate(const std::string &key)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    ++invalidations;
+
+    size_t dot = key.rfind('.');
+    if (dot == std::string::npos) {
+        return;
+    }
+
+    std::string player = key.substr(0, dot);
+    ++epochs[Slot(player)];
+
+    auto iter = players.find(player);
+    if (iter != players.end()) {
+        lru.erase(iter->second.lru);
+        players.erase(iter);
+    }
+}
+
+void ValueCache::Clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (auto &epoch : epochs) {
+        ++epoch;
+    }
+    players.clear();
+    lru.clear();
+}
+
+void ValueCache::Erase(std::string player)
+{
+    auto iter = players.find(player);
+    if (iter != players.end()) {
+        lru.erase(iter->second.lru);
+        players.erase(iter);
+    }
+}
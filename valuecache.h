@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <functional>
+
+#include "cookierow.h"
+
+/**
+ * An in-process cache of the cookie values stored in Redis, kept coherent by
+ * client side caching (CLIENT TRACKING) invalidations.
+ *
+ * Entries are keyed by the Redis key prefix of a player (their auth id) and remember
+ * which cookie ids were fetched, so a missing value is a cached "no value" rather
+ * than a miss. Any invalidated key drops the whole player.
+ *
+ * Shared between the query threads and the subscriber thread.
+ */
+class ValueCache
+{
+public:
+    typedef CookieRows rows;
+
+    ValueCache();
+
+    void SetCapacity(size_t players);
+
+    // Current invalidation epoch of player, take it before reading from Redis
+    uint64_t Epoch(const std::string &player) const
+    {
+        return epochs[Slot(player)];
+    }
+
+    // Fill out with the values of ids if every one of them is cached
+    bool Lookup(const std::string &player, const std::vector<int> &ids, rows &out);
+
+    // Cache values read from Redis, dropped if the player was invalidated since epoch
+    void Insert(const std::string &player, const std::vector<int> &ids, const rows &values, uint64_t epoch);
+
+    // Drop the player owning a Redis key ("<auth id>.<cookie id>")
+    void Invalidate(const std::string &key);
+
+    void Clear();
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> invalidations;
+    std::atomic<uint64_t> keys_saved;       // keys we did not have to read from Redis
+
+private:
+    struct entry
+    {
+        std::unordered_map<int, std::string> values;
+        std::vector<int> known;             // sorted ids fetched from Redis, with or without a value
+        std::list<std::string>::iterator lru;
+    };
+
+    void Erase(std::string player);
+
+    // Players share an epoch slot by hash, a collision only drops an insert that was fine
+    static size_t Slot(const std::string &player)
+    {
+        return std::hash<std::string>()(player) % EPOCH_SLOTS;
+    }
+
+    static const size_t EPOCH_SLOTS = 4096;
+
+    std::mutex lock;
+    std::unordered_map<std::string, entry> players;
+    std::list<std::string> lru;             // most recently used first
+    size_t capacity;
+
+    std::atomic<uint64_t> epochs[EPOCH_SLOTS];
+};
@@ -0,0 +1,407 @@
+#include "warmcache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define WARMCACHE_MAGIC "CPRCACHE"
+#define WARMCACHE_FORMAT 2
+#define WARMCACHE_MAX_AUTHID 64
+
+struct WarmCache::file_header
+{
+    char magic[8];
+    uint32_t format;
+    uint32_t entries;
+    uint32_t entry_size;
+    uint32_t reserved;
+    uint64_t clock;         // LRU clock, bumped on every load and store
+};
+
+struct WarmCache::entry_header
+{
+    uint64_t seq;           // odd while the entry is being written, 0 when free
+    uint64_t used;          // LRU stamp
+    int64_t saved;          // unix time of the last store
+    uint64_t version;       // version of the values in Redis when they were stored
+    uint32_t length;        // bytes of record data following the header
+    uint32_t checksum;
+    char authid[WARMCACHE_MAX_AUTHID];
+    // followed by records: [u8 name length][name][u16 value length][value]
+};
+
+WarmCache::WarmCache() :
+    base(nullptr), mapped_size(0),
+#ifdef _WIN32
+    file(INVALID_HANDLE_VALUE), mapping(nullptr),
+#else
+    fd(-1),
+#endif
+    entry_count(0), entry_size(0), max_age(0)
+{
+}
+
+WarmCache::~WarmCache()
+{
+    Close();
+}
+
+bool WarmCache::Open(const char *path, uint32_t entries, uint32_t size, int64_t age)
+{
+    Close();
+
+    if (entries == 0 || size <= sizeof(entry_header)) {
+        return false;
+    }
+
+    entry_count = entries;
+    entry_size = (size + 7) & ~7u;
+    max_age = age;
+    mapped_size = sizeof(file_header) + (size_t)entry_count * entry_size;
+
+#ifdef _WIN32
+    // No sharing, a second server using the same file fails to open it instead of overwriting our entries
+    file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER length;
+    length.QuadPart = (LONGLONG)mapped_size;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, length.HighPart, length.LowPart, NULL);
+    if (mapping == nullptr) {
+        Close();
+        return false;
+    }
+
+    base = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, mapped_size);
+#else
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Another server sharing this install has it, each process keeps its own index and LRU
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        Close();
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size != mapped_size && ftruncate(fd, (off_t)mapped_size) != 0)) {
+        Close();
+        return false;
+    }
+
+    void *addr = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    base = addr == MAP_FAILED ? nullptr : (unsigned char *)addr;
+#endif
+
+    if (base == nullptr) {
+        Close();
+        return false;
+    }
+
+    file_header *header = (file_header *)base;
+    if (memcmp(header->magic, WARMCACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->format != WARMCACHE_FORMAT
+        || header->entries != entry_count
+        || header->entry_size != entry_size) {
+        Rebuild();
+        return true;
+    }
+
+    for (uint32_t slot = 0; slot < entry_count; ++slot) {
+        entry_header *entry = Entry(slot);
+        if (entry->seq == 0) {
+            continue;
+        }
+
+        if (!IsValid(entry)) {
+            // torn or corrupted write, drop it
+            entry->seq = 0;
+            continue;
+        }
+
+        index[entry->authid] = slot;
+    }
+
+    return true;
+}
+
+void WarmCache::Close()
+{
+    index.clear();
+
+    if (base) {
+        Flush();
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap(base, mapped_size);
+#endif
+        base = nullptr;
+    }
+
+#ifdef _WIN32
+    if (mapping) {
+        CloseHandle(mapping);
+        mapping = nullptr;
+    }
+
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+bool WarmCache::Load(const char *authid, values &out, uint64_t &version)
+{
+    out.clear();
+    version = 0;
+
+    if (!base) {
+        return false;
+    }
+
+    auto iter = index.find(authid);
+    if (iter == index.end()) {
+        return false;
+    }
+
+    entry_header *entry = Entry(iter->second);
+    if (!IsValid(entry) || strcmp(entry->authid, authid) != 0) {
+        entry->seq = 0;
+        index.erase(iter);
+        return false;
+    }
+
+    if (max_age > 0 && time(NULL) - entry->saved > max_age) {
+        return false;
+    }
+
+    const unsigned char *data = (const unsigned char *)(entry + 1);
+    const unsigned char *end = data + entry->length;
+    while (data < end) {
+        size_t name_len = *data++;
+        if (end - data < (ptrdiff_t)(name_len + 2)) {
+            out.clear();
+            return false;
+        }
+
+        const char *name = (const char *)data;
+        data += name_len;
+
+        size_t value_len = data[0] | (data[1] << 8);
+        data += 2;
+        if (end - data < (ptrdiff_t)value_len) {
+            out.clear();
+            return false;
+        }
+
+        out.emplace_back(std::string(name, name_len), std::string((const char *)data, value_len));
+        data += value_len;
+    }
+
+    version = entry->version;
+    entry->used = ++((file_header *)base)->clock;
+    return true;
+}
+
+bool WarmCache::Store(const char *authid, const values &in, uint64_t version)
+{
+    if (!base) {
+        return false;
+    }
+
+    size_t authid_len = strlen(authid);
+    if (authid_len == 0 || authid_len >= WARMCACHE_MAX_AUTHID) {
+        return false;
+    }
+
+    size_t length = 0;
+    for (const auto &[name, value] : in) {
+        if (name.size() > 0xFF || value.size() > 0xFFFF) {
+            continue;
+        }
+        length += 1 + name.size() + 2 + value.size();
+    }
+
+    // Player does not fit in an entry, make sure we do not serve an outdated copy
+    if (length > entry_size - sizeof(entry_header)) {
+        Evict(authid);
+        return false;
+    }
+
+    uint32_t slot;
+    auto iter = index.find(authid);
+    if (iter != index.end()) {
+        slot = iter->second;
+    } else {
+        // Take a free entry, or the least recently used one
+        slot = 0;
+        uint64_t oldest = UINT64_MAX;
+        for (uint32_t i = 0; i < entry_count; ++i) {
+            entry_header *entry = Entry(i);
+            if (entry->seq == 0) {
+                slot = i;
+                break;
+            }
+
+            if (entry->used < oldest) {
+                oldest = entry->used;
+                slot = i;
+            }
+        }
+
+        entry_header *victim = Entry(slot);
+        if (victim->seq != 0) {
+            index.erase(victim->authid);
+        }
+        index[authid] = slot;
+    }
+
+    entry_header *entry = Entry(slot);
+    entry->seq = (entry->seq + 1) | 1;
+
+    unsigned char *data = (unsigned char *)(entry + 1);
+    for (const auto &[name, value] : in) {
+        if (name.size() > 0xFF || value.size() > 0xFFFF) {
+            continue;
+        }
+
+        *data++ = (unsigned char)name.size();
+        memcpy(data, name.data(), name.size());
+        data += name.size();
+
+        *data++ = (unsigned char)(value.size() & 0xFF);
+        *data++ = (unsigned char)(value.size() >> 8);
+        memcpy(data, value.data(), value.size());
+        data += value.size();
+    }
+
+    memset(entry->authid, 0, sizeof(entry->authid));
+    memcpy(entry->authid, authid, authid_len);
+    entry->length = (uint32_t)length;
+    entry->saved = time(NULL);
+    entry->version = version;
+    entry->used = ++((file_header *)base)->clock;
+    entry->checksum = Checksum(entry);
+    entry->seq++;
+
+    return true;
+}
+
+void WarmCache::Evict(const char *authid)
+{
+    if (!base) {
+        return;
+    }
+
+    auto iter = index.find(authid);
+    if (iter == index.end()) {
+        return;
+    }
+
+    Entry(iter->second)->seq = 0;
+    index.erase(iter);
+}
+
+void WarmCache::Unverify()
+{
+    if (!base) {
+        return;
+    }
+
+    for (const auto &[authid, slot] : index) {
+        entry_header *entry = Entry(slot);
+        entry->seq = (entry->seq + 1) | 1;
+        entry->version = 0;
+        entry->checksum = Checksum(entry);
+        entry->seq++;
+    }
+}
+
+void WarmCache::Flush()
+{
+    if (!base) {
+        return;
+    }
+
+#ifdef _WIN32
+    FlushViewOfFile(base, mapped_size);
+#else
+    msync(base, mapped_size, MS_ASYNC);
+#endif
+}
+
+WarmCache::entry_header *WarmCache::Entry(uint32_t slot) const
+{
+    return (entry_header *)(base + sizeof(file_header) + (size_t)slot * entry_size);
+}
+
+bool WarmCache::IsValid(const entry_header *entry) const
+{
+    if (entry->seq == 0 || (entry->seq & 1)) {
+        return false;
+    }
+
+    if (entry->length > entry_size - sizeof(entry_header)) {
+        return false;
+    }
+
+    if (memchr(entry->authid, '\0', sizeof(entry->authid)) == nullptr) {
+        return false;
+    }
+
+    return entry->checksum == Checksum(entry);
+}
+
+void WarmCache::Rebuild()
+{
+    memset(base, 0, mapped_size);
+
+    file_header *header = (file_header *)base;
+    memcpy(header->magic, WARMCACHE_MAGIC, sizeof(header->magic));
+    header->format = WARMCACHE_FORMAT;
+    header->entries = entry_count;
+    header->entry_size = entry_size;
+    header->clock = 0;
+
+    index.clear();
+}
+
+uint32_t WarmCache::Checksum(const entry_header *entry)
+{
+    // FNV-1a over the auth id and the records
+    uint32_t hash = 2166136261u;
+
+    const unsigned char *p = (const unsigned char *)entry->authid;
+    for (size_t i = 0; i < sizeof(entry->authid); ++i) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+
+    p = (const unsigned char *)(entry + 1);
+    for (uint32_t i = 0; i < entry->length; ++i) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+
+    hash = (hash ^ (uint32_t)entry->version) * 16777619u;
+    hash ^= (uint32_t)entry->saved;
+    return hash;
+}
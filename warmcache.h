@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+/**
+ * A persistent, memory-mapped cache of the cookie values of recently seen players.
+ *
+ * The file is a fixed number of fixed-size entries. Each entry holds the values of
+ * one player, keyed by auth id, and is evicted in LRU order when the cache is full.
+ * Entries are written seqlock-style (odd sequence while writing) and checksummed,
+ * so a torn write from a crash is detected and dropped on the next open. Entries
+ * older than the max age are considered stale and never served.
+ *
+ * Every entry also records the version of the player's values (the counter each
+ * write increments in Redis) it was saved at, the caller compares it with the
+ * current one before trusting the values.
+ *
+ * The file is locked while open, a second process using it gets no warm cache.
+ * Only used from the main thread.
+ */
+class WarmCache
+{
+public:
+    typedef std::vector<std::pair<std::string, std::string>> values;
+
+    WarmCache();
+    ~WarmCache();
+
+    /**
+     * Map the cache file, creating or rebuilding it if the layout does not match
+     *
+     * @param path          Path of the cache file
+     * @param entries       Maximum number of players kept in the cache
+     * @param entry_size    Size of a single entry in bytes (header included)
+     * @param max_age       Entries saved more than max_age seconds ago are stale
+     */
+    bool Open(const char *path, uint32_t entries, uint32_t entry_size, int64_t max_age);
+    void Close();
+
+    bool IsOpen() const
+    {
+        return base != nullptr;
+    }
+
+    // Fill out with the cached (cookie name, value) pairs of authid and the version they were saved at
+    bool Load(const char *authid, values &out, uint64_t &version);
+
+    // Save the values of authid at version, evicting the least recently used entry if needed
+    bool Store(const char *authid, const values &in, uint64_t version);
+
+    void Evict(const char *authid);
+
+    // Forget the version of every entry, they are loaded in full the next time
+    void Unverify();
+
+    void Flush();
+
+private:
+    struct file_header;
+    struct entry_header;
+
+    entry_header *Entry(uint32_t slot) const;
+    bool IsValid(const entry_header *entry) const;
+    void Rebuild();
+
+    static uint32_t Checksum(const entry_header *entry);
+
+    unsigned char *base;
+    size_t mapped_size;
+
+#ifdef _WIN32
+    void *file;
+    void *mapping;
+#else
+    int fd;
+#endif
+
+    uint32_t entry_count;
+    uint32_t entry_size;
+    int64_t max_age;
+
+    std::unordered_map<std::string, uint32_t> index;
+};